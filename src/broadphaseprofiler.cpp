@@ -0,0 +1,118 @@
+#include "broadphaseprofiler.h"
+
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock ProfileClock;
+
+static double secondsSince(ProfileClock::time_point start)
+{
+	return std::chrono::duration<double>(ProfileClock::now() - start).count();
+}
+
+ProfiledBroadphase::ProfiledBroadphase(btBroadphaseInterface* broadphase)
+	: broadphase(broadphase)
+{
+	resetStats();
+	broadphase->getOverlappingPairCache()->setOverlapFilterCallback(this);
+}
+
+ProfiledBroadphase::~ProfiledBroadphase()
+{
+	broadphase->getOverlappingPairCache()->setOverlapFilterCallback(nullptr);
+	delete broadphase;
+}
+
+void ProfiledBroadphase::resetStats()
+{
+	stats.aabbUpdateSeconds = 0.0;
+	stats.pairUpdateSeconds = 0.0;
+	stats.reportedOverlaps = 0;
+	stats.numPairUpdates = 0;
+}
+
+btBroadphaseProxy* ProfiledBroadphase::createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher)
+{
+	return broadphase->createProxy(aabbMin, aabbMax, shapeType, userPtr, collisionFilterGroup, collisionFilterMask, dispatcher);
+}
+
+void ProfiledBroadphase::destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher)
+{
+	broadphase->destroyProxy(proxy, dispatcher);
+}
+
+void ProfiledBroadphase::setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher)
+{
+	ProfileClock::time_point start = ProfileClock::now();
+	broadphase->setAabb(proxy, aabbMin, aabbMax, dispatcher);
+	stats.aabbUpdateSeconds += secondsSince(start);
+}
+
+void ProfiledBroadphase::getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const
+{
+	broadphase->getAabb(proxy, aabbMin, aabbMax);
+}
+
+void ProfiledBroadphase::rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin, const btVector3& aabbMax)
+{
+	broadphase->rayTest(rayFrom, rayTo, rayCallback, aabbMin, aabbMax);
+}
+
+void ProfiledBroadphase::aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback)
+{
+	broadphase->aabbTest(aabbMin, aabbMax, callback);
+}
+
+void ProfiledBroadphase::calculateOverlappingPairs(btDispatcher* dispatcher)
+{
+	ProfileClock::time_point start = ProfileClock::now();
+	broadphase->calculateOverlappingPairs(dispatcher);
+	stats.pairUpdateSeconds += secondsSince(start);
+	stats.numPairUpdates++;
+}
+
+btOverlappingPairCache* ProfiledBroadphase::getOverlappingPairCache()
+{
+	return broadphase->getOverlappingPairCache();
+}
+
+const btOverlappingPairCache* ProfiledBroadphase::getOverlappingPairCache() const
+{
+	return broadphase->getOverlappingPairCache();
+}
+
+void ProfiledBroadphase::getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const
+{
+	broadphase->getBroadphaseAabb(aabbMin, aabbMax);
+}
+
+void ProfiledBroadphase::resetPool(btDispatcher* dispatcher)
+{
+	broadphase->resetPool(dispatcher);
+}
+
+void ProfiledBroadphase::printStats()
+{
+	broadphase->printStats();
+}
+
+bool ProfiledBroadphase::needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const
+{
+	stats.reportedOverlaps++;
+
+	// same test the pair cache does without a filter callback
+	bool collides = (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) != 0;
+	collides = collides && (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask);
+
+	return collides;
+}
+
+btDbvtBroadphase* findDbvtBroadphase(btBroadphaseInterface* broadphase)
+{
+	ProfiledBroadphase* profiled = dynamic_cast<ProfiledBroadphase*>(broadphase);
+	if (profiled)
+		broadphase = profiled->getWrapped();
+
+	return dynamic_cast<btDbvtBroadphase*>(broadphase);
+}
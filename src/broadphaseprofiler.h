@@ -0,0 +1,69 @@
+#ifndef BROADPHASEPROFILER_H
+#define BROADPHASEPROFILER_H
+
+#include "btBulletDynamicsCommon.h"
+
+class btDbvtBroadphase;
+
+// accumulated since the last resetStats
+struct BroadphaseStats
+{
+	// time in setAabb (sweep and prune sorts its axes there, the dbvt moves leaves) and in calculateOverlappingPairs
+	double aabbUpdateSeconds;
+	double pairUpdateSeconds;
+
+	// overlapping proxy pairs the broadphase reported to the pair cache, cached pairs included
+	unsigned long long reportedOverlaps;
+
+	int numPairUpdates;
+};
+
+// forwards every call to the wrapped broadphase, timing the two update paths and counting the overlaps it
+// reports through the pair cache's filter callback (with the default group/mask test). takes ownership
+class ProfiledBroadphase : public btBroadphaseInterface, public btOverlapFilterCallback
+{
+public:
+	explicit ProfiledBroadphase(btBroadphaseInterface* broadphase);
+	virtual ~ProfiledBroadphase();
+
+	btBroadphaseInterface* getWrapped()
+	{
+		return broadphase;
+	}
+
+	const BroadphaseStats& getStats() const
+	{
+		return stats;
+	}
+
+	void resetStats();
+
+	virtual btBroadphaseProxy* createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher);
+	virtual void destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher);
+	virtual void setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher);
+	virtual void getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const;
+	virtual void rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin = btVector3(0, 0, 0), const btVector3& aabbMax = btVector3(0, 0, 0));
+	virtual void aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback);
+	virtual void calculateOverlappingPairs(btDispatcher* dispatcher);
+	virtual btOverlappingPairCache* getOverlappingPairCache();
+	virtual const btOverlappingPairCache* getOverlappingPairCache() const;
+	virtual void getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const;
+	virtual void resetPool(btDispatcher* dispatcher);
+	virtual void printStats();
+
+	virtual bool needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const;
+
+private:
+	btBroadphaseInterface* broadphase;
+
+	// the filter callback is const
+	mutable BroadphaseStats stats;
+
+	ProfiledBroadphase(const ProfiledBroadphase& that);
+	ProfiledBroadphase& operator=(const ProfiledBroadphase& that);
+};
+
+// the broadphase itself or the one a ProfiledBroadphase wraps if it is a btDbvtBroadphase, otherwise null
+btDbvtBroadphase* findDbvtBroadphase(btBroadphaseInterface* broadphase);
+
+#endif
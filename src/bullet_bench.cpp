@@ -0,0 +1,293 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
+
+// bt
+#include "btBulletDynamicsCommon.h"
+#include "LinearMath/btQuickprof.h"
+
+#include "physicsscene.h"
+#include "broadphaseprofiler.h"
+
+// headless benchmark of the tower scene, no window or gl context required
+
+struct BenchConfig
+{
+	PhysicsSceneConfig scene;
+	int numSteps = 600;
+	int numWarmupSteps = 0;
+	bool compareBroadphases = false;
+	bool compareAlgorithms = false;
+};
+
+// per-step timings in milliseconds
+struct StepSample
+{
+	double stepTime;
+	double collisionTime;
+	double broadphaseTime;
+	double solverTime;
+	int numPairs;
+};
+
+static void printUsage(const char* app)
+{
+	printf("usage: %s [--steps N] [--warmup N] [--compare-broadphases] [--compare-algorithms] [--layers N] [--boxes N] [--radius R] [--spheres N] [--broadphase dbvt|sap|sap32|simple|grid] [--grid-cell S] [--default-algorithms] [--threads N] [--scheduler sequential|internal|omp|tbb]\n", app);
+}
+
+static bool parseArgs(int argc, char* argv[], BenchConfig& config)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--steps") == 0 && hasValue)
+			config.numSteps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+			config.numWarmupSteps = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--compare-broadphases") == 0)
+			config.compareBroadphases = true;
+		else if (strcmp(argv[i], "--compare-algorithms") == 0)
+			config.compareAlgorithms = true;
+		else if (!parsePhysicsSceneArg(argc, argv, i, config.scene))
+			return false;
+	}
+
+	return config.numSteps > 0 && config.scene.numLayers > 0 && config.scene.numBoxesPerLayer > 0;
+}
+
+// sum the total time of every profile node called name, below the iterator's current parent
+static double findProfileTime(CProfileIterator* it, const char* name)
+{
+	double time = 0.0;
+	int numChildren = 0;
+
+	for (it->First(); !it->Is_Done(); it->Next())
+	{
+		if (strcmp(it->Get_Current_Name(), name) == 0)
+			time += it->Get_Current_Total_Time();
+		numChildren++;
+	}
+
+	for (int i = 0; i < numChildren; ++i)
+	{
+		it->Enter_Child(i);
+		time += findProfileTime(it, name);
+		it->Enter_Parent();
+	}
+
+	return time;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0.0;
+
+	size_t n = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+	std::nth_element(values.begin(), values.begin() + n, values.end());
+
+	return values[n];
+}
+
+static void printStats(const char* label, const std::vector<StepSample>& samples, double StepSample::* member)
+{
+	std::vector<double> values;
+	values.reserve(samples.size());
+
+	double sum = 0.0;
+	for (size_t i = 0; i < samples.size(); ++i)
+	{
+		values.push_back(samples[i].*member);
+		sum += samples[i].*member;
+	}
+
+	printf("%-12s mean %8.3f ms  p50 %8.3f ms  p99 %8.3f ms\n", label, sum / values.size(), percentile(values, 0.5), percentile(values, 0.99));
+}
+
+// run the scene once per broadphase type. the overlaps are the ones each broadphase reports to the pair
+// cache per step, for the dbvt every overlap of a moved proxy, for sweep and prune only new ones
+static void compareBroadphases(const BenchConfig& config)
+{
+	const BroadphaseType types[] = { BroadphaseType::Dbvt, BroadphaseType::AxisSweep, BroadphaseType::AxisSweep32, BroadphaseType::Simple, BroadphaseType::HashGrid };
+
+	printf("%-8s %10s %10s %14s %10s %10s %10s\n", "type", "avg pairs", "max pairs", "overlaps/step", "aabb ms", "pairs ms", "step ms");
+
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+	{
+		PhysicsSceneConfig scene = config.scene;
+		scene.broadphase = types[t];
+		scene.profileBroadphase = true;
+
+		initPhysics(scene);
+
+		for (int i = 0; i < config.numWarmupSteps; ++i)
+			stepPhysics();
+
+		// insertion and warmup are not part of the measurement
+		ProfiledBroadphase* broadphase = static_cast<ProfiledBroadphase*>(dynamicsWorld->getBroadphase());
+		broadphase->resetStats();
+
+		double sumPairs = 0.0;
+		int maxPairs = 0;
+
+		std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < config.numSteps; ++i)
+		{
+			stepPhysics();
+
+			int numPairs = broadphase->getOverlappingPairCache()->getNumOverlappingPairs();
+			sumPairs += numPairs;
+			maxPairs = std::max(maxPairs, numPairs);
+		}
+		std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+		const BroadphaseStats& stats = broadphase->getStats();
+		double steps = config.numSteps;
+		printf("%-8s %10.1f %10d %14.1f %10.3f %10.3f %10.3f\n", getBroadphaseName(types[t]),
+			sumPairs / steps, maxPairs, stats.reportedOverlaps / steps,
+			stats.aabbUpdateSeconds * 1000.0 / steps, stats.pairUpdateSeconds * 1000.0 / steps,
+			std::chrono::duration<double, std::milli>(t1 - t0).count() / steps);
+
+		cleanupPhysics();
+	}
+}
+
+static int countContacts()
+{
+	int numContacts = 0;
+	for (int i = 0; i < dispatcher->getNumManifolds(); ++i)
+		numContacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+
+	return numContacts;
+}
+
+// run the scene with Bullet's narrowphase and with the one from contactalgorithms.h. narrowphase is the time
+// in the dispatcher's pair loop, contact generation and manifold updates of every overlapping pair
+static void compareAlgorithms(const BenchConfig& config)
+{
+	printf("%-8s %14s %10s %10s %10s %10s\n", "narrow", "mean ms", "p50 ms", "p99 ms", "step ms", "contacts");
+
+	for (int custom = 0; custom < 2; ++custom)
+	{
+		PhysicsSceneConfig scene = config.scene;
+		scene.customContactAlgorithms = custom != 0;
+
+		initPhysics(scene);
+
+		for (int i = 0; i < config.numWarmupSteps; ++i)
+			stepPhysics();
+
+		std::vector<double> narrowphaseTimes;
+		narrowphaseTimes.reserve(config.numSteps);
+		double sumNarrowphase = 0.0;
+		double sumContacts = 0.0;
+
+		std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < config.numSteps; ++i)
+		{
+			CProfileManager::Reset();
+			stepPhysics();
+
+			CProfileIterator* it = CProfileManager::Get_Iterator();
+			double narrowphaseTime = findProfileTime(it, "dispatchAllCollisionPairs");
+			CProfileManager::Release_Iterator(it);
+
+			narrowphaseTimes.push_back(narrowphaseTime);
+			sumNarrowphase += narrowphaseTime;
+			sumContacts += countContacts();
+		}
+		std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+		double steps = config.numSteps;
+		printf("%-8s %14.3f %10.3f %10.3f %10.3f %10.1f\n", custom ? "custom" : "bullet",
+			sumNarrowphase / steps, percentile(narrowphaseTimes, 0.5), percentile(narrowphaseTimes, 0.99),
+			std::chrono::duration<double, std::milli>(t1 - t0).count() / steps, sumContacts / steps);
+
+		cleanupPhysics();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	BenchConfig config;
+	if (!parseArgs(argc, argv, config))
+	{
+		printUsage(argv[0]);
+		return -1;
+	}
+
+	if (config.compareBroadphases)
+	{
+		printf("broadphases: %d boxes, %d spheres, %d steps (+%d warmup)\n", config.scene.numLayers * config.scene.numBoxesPerLayer, config.scene.numSpheres, config.numSteps, config.numWarmupSteps);
+		compareBroadphases(config);
+		CProfileManager::CleanupMemory();
+		return 0;
+	}
+
+	if (config.compareAlgorithms)
+	{
+		printf("contact algorithms: %d boxes, %d spheres, %d steps (+%d warmup)\n", config.scene.numLayers * config.scene.numBoxesPerLayer, config.scene.numSpheres, config.numSteps, config.numWarmupSteps);
+		compareAlgorithms(config);
+		CProfileManager::CleanupMemory();
+		return 0;
+	}
+
+	initPhysics(config.scene);
+
+	printf("bodies: %d (%d layers x %d boxes, ring radius %.2f, %d spheres)\n", dynamicsWorld->getNumCollisionObjects(), config.scene.numLayers, config.scene.numBoxesPerLayer, config.scene.ringRadius, config.scene.numSpheres);
+	printf("broadphase: %s\n", getBroadphaseName(config.scene.broadphase));
+	printf("steps: %d (+%d warmup)\n", config.numSteps, config.numWarmupSteps);
+
+	for (int i = 0; i < config.numWarmupSteps; ++i)
+		stepPhysics();
+
+	std::vector<StepSample> samples;
+	samples.reserve(config.numSteps);
+
+	for (int i = 0; i < config.numSteps; ++i)
+	{
+		CProfileManager::Reset();
+
+		std::chrono::high_resolution_clock::time_point t0 = std::chrono::high_resolution_clock::now();
+		stepPhysics();
+		std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+		StepSample sample;
+		sample.stepTime = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+		// Bullet's profiler reports milliseconds, all zero if it was built with BT_NO_PROFILE
+		CProfileIterator* it = CProfileManager::Get_Iterator();
+		sample.collisionTime = findProfileTime(it, "performDiscreteCollisionDetection");
+		sample.broadphaseTime = findProfileTime(it, "calculateOverlappingPairs");
+		sample.solverTime = findProfileTime(it, "solveConstraints");
+		CProfileManager::Release_Iterator(it);
+
+		sample.numPairs = dynamicsWorld->getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+
+		samples.push_back(sample);
+	}
+
+	printStats("step", samples, &StepSample::stepTime);
+	printStats("collision", samples, &StepSample::collisionTime);
+	printStats("broadphase", samples, &StepSample::broadphaseTime);
+	printStats("solver", samples, &StepSample::solverTime);
+
+	int maxPairs = 0;
+	double sumPairs = 0.0;
+	for (size_t i = 0; i < samples.size(); ++i)
+	{
+		maxPairs = std::max(maxPairs, samples[i].numPairs);
+		sumPairs += samples[i].numPairs;
+	}
+	printf("%-12s mean %8.1f     max %8d\n", "pairs", sumPairs / samples.size(), maxPairs);
+
+	cleanupPhysics();
+	CProfileManager::CleanupMemory();
+
+	return 0;
+}
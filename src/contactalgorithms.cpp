@@ -0,0 +1,322 @@
+#include "contactalgorithms.h"
+
+#include "BulletCollision/CollisionDispatch/btCollisionCreateFunc.h"
+#include "BulletCollision/CollisionDispatch/btCollisionObjectWrapper.h"
+#include "BulletCollision/CollisionDispatch/btManifoldResult.h"
+#include "BulletCollision/CollisionDispatch/btBoxBoxDetector.h"
+
+#include <new>
+
+#if (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)) && !defined(BT_USE_DOUBLE_PRECISION)
+#define CONTACTALGORITHMS_SSE
+#include <xmmintrin.h>
+#endif
+
+ContactAlgorithm::ContactAlgorithm(btPersistentManifold* manifold, const btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, bool isSwapped)
+	: btActivatingCollisionAlgorithm(ci, body0Wrap, body1Wrap), manifold(manifold), ownManifold(false), isSwapped(isSwapped)
+{
+	const btCollisionObject* objA = isSwapped ? body1Wrap->getCollisionObject() : body0Wrap->getCollisionObject();
+	const btCollisionObject* objB = isSwapped ? body0Wrap->getCollisionObject() : body1Wrap->getCollisionObject();
+
+	if (!manifold && m_dispatcher->needsCollision(objA, objB))
+	{
+		this->manifold = m_dispatcher->getNewManifold(objA, objB);
+		ownManifold = true;
+	}
+}
+
+ContactAlgorithm::~ContactAlgorithm()
+{
+	if (ownManifold && manifold)
+		m_dispatcher->releaseManifold(manifold);
+}
+
+void ContactAlgorithm::processCollision(const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	if (!manifold)
+		return;
+
+	// the manifold result swaps the contact back if its bodies are in the other order
+	resultOut->setPersistentManifold(manifold);
+
+	if (isSwapped)
+		collide(body1Wrap, body0Wrap, dispatchInfo, resultOut);
+	else
+		collide(body0Wrap, body1Wrap, dispatchInfo, resultOut);
+
+	// drop the points that separated or slid apart since they were added
+	if (ownManifold)
+		resultOut->refreshContactPoints();
+}
+
+btScalar ContactAlgorithm::calculateTimeOfImpact(btCollisionObject* body0, btCollisionObject* body1, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	// not supported, like Bullet's box and sphere algorithms
+	return btScalar(1.);
+}
+
+void ContactAlgorithm::getAllContactManifolds(btManifoldArray& manifoldArray)
+{
+	if (manifold && ownManifold)
+		manifoldArray.push_back(manifold);
+}
+
+// world space plane as normal and distance from the origin
+static void getWorldPlane(const btCollisionObjectWrapper* planeWrap, btVector3& normal, btScalar& constant)
+{
+	const btStaticPlaneShape* plane = static_cast<const btStaticPlaneShape*>(planeWrap->getCollisionShape());
+	const btTransform& transform = planeWrap->getWorldTransform();
+
+	normal = transform.getBasis() * plane->getPlaneNormal();
+	constant = plane->getPlaneConstant() + normal.dot(transform.getOrigin());
+}
+
+void SphereSphereAlgorithm::collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	btScalar radiusA = static_cast<const btSphereShape*>(wrapA->getCollisionShape())->getRadius();
+	btScalar radiusB = static_cast<const btSphereShape*>(wrapB->getCollisionShape())->getRadius();
+
+	btVector3 diff = wrapA->getWorldTransform().getOrigin() - wrapB->getWorldTransform().getOrigin();
+	btScalar dist2 = diff.length2();
+
+	// reject on the squared distance, most pairs from the broadphase do not touch
+	btScalar maxDist = radiusA + radiusB + manifold->getContactBreakingThreshold();
+	if (dist2 > maxDist * maxDist)
+		return;
+
+	btScalar dist = btSqrt(dist2);
+	btVector3 normalOnB = dist > SIMD_EPSILON ? diff / dist : btVector3(1, 0, 0);
+	btVector3 pointOnB = wrapB->getWorldTransform().getOrigin() + normalOnB * radiusB;
+
+	resultOut->addContactPoint(normalOnB, pointOnB, dist - radiusA - radiusB);
+}
+
+void SphereBoxAlgorithm::collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	btScalar radius = static_cast<const btSphereShape*>(wrapA->getCollisionShape())->getRadius();
+	btVector3 halfExtents = static_cast<const btBoxShape*>(wrapB->getCollisionShape())->getHalfExtentsWithMargin();
+	const btTransform& boxTransform = wrapB->getWorldTransform();
+
+	// closest point on the box in its local space, the clamp is two simd min/max in Bullet's sse build
+	btVector3 center = boxTransform.invXform(wrapA->getWorldTransform().getOrigin());
+	btVector3 closest = center;
+	closest.setMax(-halfExtents);
+	closest.setMin(halfExtents);
+
+	btVector3 normal;
+	btScalar depth;
+
+	if (closest == center)
+	{
+		// the center is inside, push the sphere out through the nearest face
+		int axis = 0;
+		btScalar faceDist = halfExtents[0] - btFabs(center[0]);
+		for (int i = 1; i < 3; ++i)
+		{
+			btScalar d = halfExtents[i] - btFabs(center[i]);
+			if (d < faceDist)
+			{
+				faceDist = d;
+				axis = i;
+			}
+		}
+
+		normal.setZero();
+		normal[axis] = center[axis] < 0 ? btScalar(-1.) : btScalar(1.);
+		closest[axis] = normal[axis] * halfExtents[axis];
+		depth = -faceDist - radius;
+	}
+	else
+	{
+		btVector3 diff = center - closest;
+		btScalar dist2 = diff.length2();
+
+		btScalar maxDist = radius + manifold->getContactBreakingThreshold();
+		if (dist2 > maxDist * maxDist)
+			return;
+
+		btScalar dist = btSqrt(dist2);
+		normal = diff / dist;
+		depth = dist - radius;
+	}
+
+	resultOut->addContactPoint(boxTransform.getBasis() * normal, boxTransform(closest), depth);
+}
+
+void SpherePlaneAlgorithm::collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	btScalar radius = static_cast<const btSphereShape*>(wrapA->getCollisionShape())->getRadius();
+
+	btVector3 normal;
+	btScalar constant;
+	getWorldPlane(wrapB, normal, constant);
+
+	const btVector3& center = wrapA->getWorldTransform().getOrigin();
+	btScalar centerDist = normal.dot(center) - constant;
+	btScalar depth = centerDist - radius;
+
+	if (depth < manifold->getContactBreakingThreshold())
+		resultOut->addContactPoint(normal, center - normal * centerDist, depth);
+}
+
+void BoxPlaneAlgorithm::collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	btVector3 halfExtents = static_cast<const btBoxShape*>(wrapA->getCollisionShape())->getHalfExtentsWithMargin();
+	const btTransform& boxTransform = wrapA->getWorldTransform();
+	const btMatrix3x3& basis = boxTransform.getBasis();
+
+	btVector3 normal;
+	btScalar constant;
+	getWorldPlane(wrapB, normal, constant);
+
+	// corner i has the signs of bits 0, 1, 2 on x, y, z. its distance to the plane is the center's distance
+	// plus the signed projections of the half extents on the plane normal
+	btScalar centerDist = normal.dot(boxTransform.getOrigin()) - constant;
+	btVector3 localNormal = normal * basis;
+	btScalar px = halfExtents[0] * localNormal[0];
+	btScalar py = halfExtents[1] * localNormal[1];
+	btScalar pz = halfExtents[2] * localNormal[2];
+
+	btScalar threshold = manifold->getContactBreakingThreshold();
+
+	// the deepest corner is at least this deep, nothing can touch if it is beyond the threshold
+	if (centerDist - btFabs(px) - btFabs(py) - btFabs(pz) >= threshold)
+		return;
+
+	ATTRIBUTE_ALIGNED16(btScalar dist[8]);
+#ifdef CONTACTALGORITHMS_SSE
+	__m128 xy = _mm_add_ps(_mm_set1_ps(centerDist), _mm_add_ps(_mm_mul_ps(_mm_setr_ps(-1, 1, -1, 1), _mm_set1_ps(px)), _mm_mul_ps(_mm_setr_ps(-1, -1, 1, 1), _mm_set1_ps(py))));
+	__m128 z = _mm_set1_ps(pz);
+	_mm_store_ps(dist, _mm_sub_ps(xy, z));
+	_mm_store_ps(dist + 4, _mm_add_ps(xy, z));
+#else
+	for (int i = 0; i < 8; ++i)
+		dist[i] = centerDist + ((i & 1) ? px : -px) + ((i & 2) ? py : -py) + ((i & 4) ? pz : -pz);
+#endif
+
+	for (int i = 0; i < 8; ++i)
+	{
+		if (dist[i] >= threshold)
+			continue;
+
+		btVector3 localCorner((i & 1) ? halfExtents[0] : -halfExtents[0], (i & 2) ? halfExtents[1] : -halfExtents[1], (i & 4) ? halfExtents[2] : -halfExtents[2]);
+		btVector3 corner = boxTransform(localCorner);
+
+		resultOut->addContactPoint(normal, corner - normal * dist[i], dist[i]);
+	}
+}
+
+// separating axis test of two boxes in the frame of box a. rotation is b's basis in a's frame, absRotation
+// its absolute values plus an epsilon for near parallel edges, offset b's center in a's frame.
+// axes 0-2 are a's faces, 3-5 b's faces and 6-14 the edge cross products. the returned value is positive if
+// the axis separates the boxes, cross product axes are not normalized so only its sign is meaningful
+static btScalar getBoxSeparation(int axis, const btMatrix3x3& rotation, const btMatrix3x3& absRotation, const btVector3& offset, const btVector3& extentsA, const btVector3& extentsB)
+{
+	if (axis < 3)
+	{
+		int i = axis;
+		return btFabs(offset[i]) - extentsA[i] - extentsB.dot(absRotation[i]);
+	}
+
+	if (axis < 6)
+	{
+		int j = axis - 3;
+		btScalar projection = offset[0] * rotation[0][j] + offset[1] * rotation[1][j] + offset[2] * rotation[2][j];
+		btScalar radiusA = extentsA[0] * absRotation[0][j] + extentsA[1] * absRotation[1][j] + extentsA[2] * absRotation[2][j];
+		return btFabs(projection) - radiusA - extentsB[j];
+	}
+
+	int i = (axis - 6) / 3;
+	int j = (axis - 6) % 3;
+	int i1 = (i + 1) % 3;
+	int i2 = (i + 2) % 3;
+	int j1 = (j + 1) % 3;
+	int j2 = (j + 2) % 3;
+
+	btScalar projection = offset[i2] * rotation[i1][j] - offset[i1] * rotation[i2][j];
+	btScalar radiusA = extentsA[i1] * absRotation[i2][j] + extentsA[i2] * absRotation[i1][j];
+	btScalar radiusB = extentsB[j1] * absRotation[i][j2] + extentsB[j2] * absRotation[i][j1];
+	return btFabs(projection) - radiusA - radiusB;
+}
+
+BoxBoxAlgorithm::BoxBoxAlgorithm(btPersistentManifold* manifold, const btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, bool isSwapped)
+	: ContactAlgorithm(manifold, ci, body0Wrap, body1Wrap, isSwapped), lastSeparatingAxis(0)
+{
+}
+
+void BoxBoxAlgorithm::collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut)
+{
+	const btBoxShape* boxA = static_cast<const btBoxShape*>(wrapA->getCollisionShape());
+	const btBoxShape* boxB = static_cast<const btBoxShape*>(wrapB->getCollisionShape());
+	const btTransform& transformA = wrapA->getWorldTransform();
+	const btTransform& transformB = wrapB->getWorldTransform();
+
+	btVector3 extentsA = boxA->getHalfExtentsWithMargin();
+	btVector3 extentsB = boxB->getHalfExtentsWithMargin();
+
+	btMatrix3x3 rotation = transformA.getBasis().transposeTimes(transformB.getBasis());
+	btMatrix3x3 absRotation = rotation.absolute();
+	for (int i = 0; i < 3; ++i)
+		absRotation[i] += btVector3(SIMD_EPSILON, SIMD_EPSILON, SIMD_EPSILON);
+	btVector3 offset = (transformB.getOrigin() - transformA.getOrigin()) * transformA.getBasis();
+
+	// btBoxBoxDetector only reports touching boxes, any separating axis means no contacts
+	if (getBoxSeparation(lastSeparatingAxis, rotation, absRotation, offset, extentsA, extentsB) > 0)
+		return;
+
+	for (int axis = 0; axis < 15; ++axis)
+	{
+		if (axis != lastSeparatingAxis && getBoxSeparation(axis, rotation, absRotation, offset, extentsA, extentsB) > 0)
+		{
+			lastSeparatingAxis = axis;
+			return;
+		}
+	}
+
+	// same contact generation as btBoxBoxCollisionAlgorithm
+	btDiscreteCollisionDetectorInterface::ClosestPointInput input;
+	input.m_maximumDistanceSquared = BT_LARGE_FLOAT;
+	input.m_transformA = transformA;
+	input.m_transformB = transformB;
+
+	btBoxBoxDetector detector(boxA, boxB);
+	detector.getClosestPoints(input, *resultOut, dispatchInfo.m_debugDraw);
+}
+
+// creates Algorithm from the dispatcher's algorithm pool
+template <typename Algorithm>
+struct ContactCreateFunc : public btCollisionAlgorithmCreateFunc
+{
+	ContactCreateFunc(bool swapped)
+	{
+		m_swapped = swapped;
+	}
+
+	virtual btCollisionAlgorithm* CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap)
+	{
+		void* mem = ci.m_dispatcher1->allocateCollisionAlgorithm(sizeof(Algorithm));
+		return new (mem) Algorithm(ci.m_manifold, ci, body0Wrap, body1Wrap, m_swapped);
+	}
+};
+
+// the dispatcher keeps the pointers, the create funcs carry no state besides the swap flag
+static ContactCreateFunc<SphereSphereAlgorithm> sphereSphereCF(false);
+static ContactCreateFunc<SphereBoxAlgorithm> sphereBoxCF(false);
+static ContactCreateFunc<SphereBoxAlgorithm> boxSphereCF(true);
+static ContactCreateFunc<SpherePlaneAlgorithm> spherePlaneCF(false);
+static ContactCreateFunc<SpherePlaneAlgorithm> planeSphereCF(true);
+static ContactCreateFunc<BoxPlaneAlgorithm> boxPlaneCF(false);
+static ContactCreateFunc<BoxPlaneAlgorithm> planeBoxCF(true);
+static ContactCreateFunc<BoxBoxAlgorithm> boxBoxCF(false);
+
+void registerContactAlgorithms(btCollisionDispatcher* dispatcher)
+{
+	dispatcher->registerCollisionCreateFunc(SPHERE_SHAPE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE, &sphereSphereCF);
+	dispatcher->registerCollisionCreateFunc(SPHERE_SHAPE_PROXYTYPE, BOX_SHAPE_PROXYTYPE, &sphereBoxCF);
+	dispatcher->registerCollisionCreateFunc(BOX_SHAPE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE, &boxSphereCF);
+	dispatcher->registerCollisionCreateFunc(SPHERE_SHAPE_PROXYTYPE, STATIC_PLANE_PROXYTYPE, &spherePlaneCF);
+	dispatcher->registerCollisionCreateFunc(STATIC_PLANE_PROXYTYPE, SPHERE_SHAPE_PROXYTYPE, &planeSphereCF);
+	dispatcher->registerCollisionCreateFunc(BOX_SHAPE_PROXYTYPE, STATIC_PLANE_PROXYTYPE, &boxPlaneCF);
+	dispatcher->registerCollisionCreateFunc(STATIC_PLANE_PROXYTYPE, BOX_SHAPE_PROXYTYPE, &planeBoxCF);
+	dispatcher->registerCollisionCreateFunc(BOX_SHAPE_PROXYTYPE, BOX_SHAPE_PROXYTYPE, &boxBoxCF);
+}
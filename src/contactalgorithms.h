@@ -0,0 +1,86 @@
+#ifndef CONTACTALGORITHMS_H
+#define CONTACTALGORITHMS_H
+
+#include "btBulletDynamicsCommon.h"
+#include "BulletCollision/CollisionDispatch/btActivatingCollisionAlgorithm.h"
+
+// narrowphase for the shape pairs of the demo: box-box, sphere-box, sphere-sphere and box/sphere against
+// a btStaticPlaneShape. the algorithms are small enough for the dispatcher's default algorithm pool.
+// registered for both orders of a pair, the create func's m_swapped flag puts the wrappers back in the
+// order the algorithm expects, contacts are added with the normal on the second shape of that order
+class ContactAlgorithm : public btActivatingCollisionAlgorithm
+{
+public:
+	ContactAlgorithm(btPersistentManifold* manifold, const btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, bool isSwapped);
+	virtual ~ContactAlgorithm();
+
+	virtual void processCollision(const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+	virtual btScalar calculateTimeOfImpact(btCollisionObject* body0, btCollisionObject* body1, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+	virtual void getAllContactManifolds(btManifoldArray& manifoldArray);
+
+protected:
+	virtual void collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut) = 0;
+
+	btPersistentManifold* manifold;
+	bool ownManifold;
+	bool isSwapped;
+};
+
+class SphereSphereAlgorithm : public ContactAlgorithm
+{
+public:
+	using ContactAlgorithm::ContactAlgorithm;
+
+protected:
+	virtual void collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+};
+
+// sphere first
+class SphereBoxAlgorithm : public ContactAlgorithm
+{
+public:
+	using ContactAlgorithm::ContactAlgorithm;
+
+protected:
+	virtual void collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+};
+
+// plane second
+class SpherePlaneAlgorithm : public ContactAlgorithm
+{
+public:
+	using ContactAlgorithm::ContactAlgorithm;
+
+protected:
+	virtual void collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+};
+
+// every corner within the contact breaking threshold becomes a contact, a box resting on the plane gets
+// its full manifold in the first step instead of one support point per step
+class BoxPlaneAlgorithm : public ContactAlgorithm
+{
+public:
+	using ContactAlgorithm::ContactAlgorithm;
+
+protected:
+	virtual void collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+};
+
+// separating axis test before btBoxBoxDetector's contact clipping. the axis that separated the boxes
+// last is tried first, neighbours in the tower that touch the broadphase bounds but not each other
+// usually stay separated along it
+class BoxBoxAlgorithm : public ContactAlgorithm
+{
+public:
+	BoxBoxAlgorithm(btPersistentManifold* manifold, const btCollisionAlgorithmConstructionInfo& ci, const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap, bool isSwapped);
+
+protected:
+	virtual void collide(const btCollisionObjectWrapper* wrapA, const btCollisionObjectWrapper* wrapB, const btDispatcherInfo& dispatchInfo, btManifoldResult* resultOut);
+
+	int lastSeparatingAxis;
+};
+
+// replace Bullet's defaults for the pairs above, works for btCollisionDispatcherMt as well
+void registerContactAlgorithms(btCollisionDispatcher* dispatcher);
+
+#endif
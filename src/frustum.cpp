@@ -0,0 +1,48 @@
+#include "frustum.h"
+
+void Frustum::extract(const float* m)
+{
+	// rows of the column-major matrix
+	btVector3 row[4];
+	btScalar w[4];
+	for (int r = 0; r < 4; ++r)
+	{
+		row[r] = btVector3(m[r], m[4 + r], m[8 + r]);
+		w[r] = m[12 + r];
+	}
+
+	// left, right, bottom, top, near, far
+	for (int i = 0; i < 3; ++i)
+	{
+		normals[2 * i + 0] = row[3] + row[i];
+		offsets[2 * i + 0] = w[3] + w[i];
+		normals[2 * i + 1] = row[3] - row[i];
+		offsets[2 * i + 1] = w[3] - w[i];
+	}
+
+	for (int i = 0; i < NumPlanes; ++i)
+	{
+		btScalar len = normals[i].length();
+		normals[i] /= len;
+		offsets[i] /= len;
+	}
+}
+
+bool Frustum::intersects(const btVector3& aabbMin, const btVector3& aabbMax) const
+{
+	for (int i = 0; i < NumPlanes; ++i)
+	{
+		const btVector3& n = normals[i];
+
+		// corner furthest along the plane normal
+		btVector3 p(
+			n.x() >= 0 ? aabbMax.x() : aabbMin.x(),
+			n.y() >= 0 ? aabbMax.y() : aabbMin.y(),
+			n.z() >= 0 ? aabbMax.z() : aabbMin.z());
+
+		if (n.dot(p) + offsets[i] < 0)
+			return false;
+	}
+
+	return true;
+}
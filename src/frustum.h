@@ -0,0 +1,21 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "btBulletDynamicsCommon.h"
+
+// view frustum as six planes n.x + d >= 0 (inside), the layout btDbvt::collideKDOP expects
+struct Frustum
+{
+	enum { NumPlanes = 6 };
+
+	btVector3 normals[NumPlanes];
+	btScalar offsets[NumPlanes];
+
+	// extract the planes from a column-major view-projection matrix
+	void extract(const float* viewProj);
+
+	// conservative test, false only if the box is completely outside one plane
+	bool intersects(const btVector3& aabbMin, const btVector3& aabbMax) const;
+};
+
+#endif
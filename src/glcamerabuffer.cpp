@@ -0,0 +1,55 @@
+#include "glcamerabuffer.h"
+#include "glstatecache.h"
+#include "glstats.h"
+#include "gldebug.h"
+
+GLCameraBuffer::GLCameraBuffer()
+	: bufferID(0)
+{
+}
+
+GLCameraBuffer::~GLCameraBuffer()
+{
+	clear();
+}
+
+void GLCameraBuffer::create()
+{
+	glGenBuffers(1, &bufferID);
+	g_gl_state.bindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(GLCameraData), NULL, GL_DYNAMIC_DRAW);
+	CHECK_GL;
+
+	// the binding point is global state, programs only refer to it
+	glBindBufferBase(GL_UNIFORM_BUFFER, BindingPoint, bufferID);
+	CHECK_GL;
+}
+
+void GLCameraBuffer::clear()
+{
+	if (bufferID)
+	{
+		g_gl_state.deleteBuffer(bufferID);
+		bufferID = 0;
+	}
+}
+
+void GLCameraBuffer::bindProgram(GLuint program)
+{
+	// glsl 330 has no layout(binding = N), the block is assigned here instead
+	GLuint blockIndex = glGetUniformBlockIndex(program, "Camera");
+	if (blockIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, blockIndex, BindingPoint);
+	CHECK_GL;
+}
+
+void GLCameraBuffer::update(const GLCameraData& data)
+{
+	g_gl_state.bindBuffer(GL_UNIFORM_BUFFER, bufferID);
+
+	// orphan the storage, the previous frame's draws may still read it
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(GLCameraData), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GLCameraData), &data);
+	CHECK_GL;
+	g_gl_stats.bufferUploads++;
+}
@@ -0,0 +1,40 @@
+#ifndef GLCAMERABUFFER_H
+#define GLCAMERABUFFER_H
+
+#include <GL/glew.h>
+
+// std140 layout of the "Camera" uniform block declared by the shaders, column-major matrices
+struct GLCameraData
+{
+	GLfloat viewProj[16];
+	GLfloat view[16];
+	GLfloat proj[16];
+	GLfloat eye[4];
+};
+
+// per-frame camera uniform buffer, bound once to a fixed binding point and shared by all programs
+class GLCameraBuffer
+{
+public:
+	enum { BindingPoint = 0 };
+
+	GLCameraBuffer();
+	~GLCameraBuffer();
+
+	void create();
+	void clear();
+
+	// connect the program's "Camera" block to the binding point, once after linking
+	static void bindProgram(GLuint program);
+
+	// upload the frame's matrices, call before the first draw of the frame
+	void update(const GLCameraData& data);
+
+private:
+	GLuint bufferID;
+
+	GLCameraBuffer(const GLCameraBuffer& that);
+	GLCameraBuffer& operator=(const GLCameraBuffer& that);
+};
+
+#endif
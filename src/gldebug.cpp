@@ -0,0 +1,220 @@
+#include "gldebug.h"
+
+#ifndef NDEBUG
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+struct GLDebugMessage
+{
+	GLenum source;
+	GLenum type;
+	GLuint id;
+	GLenum severity;
+	std::string text;
+
+	const char* file;
+	int line;
+	unsigned int count;
+};
+
+// distinct messages, the first ones without a location yet are pending until the next checkpoint
+static std::vector<GLDebugMessage> debugMessages;
+static size_t numPendingMessages = 0;
+static bool debugOutputActive = false;
+
+// messages beyond these are counted but not stored
+static const size_t maxDebugMessages = 256;
+static const size_t maxPendingMessages = 64;
+static unsigned int numDroppedMessages = 0;
+
+static const char* severityString(GLenum severity)
+{
+	switch (severity)
+	{
+	case GL_DEBUG_SEVERITY_HIGH:
+		return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM:
+		return "medium";
+	case GL_DEBUG_SEVERITY_LOW:
+		return "low";
+	default:
+		return "notification";
+	}
+}
+
+static int severityRank(GLenum severity)
+{
+	switch (severity)
+	{
+	case GL_DEBUG_SEVERITY_HIGH:
+		return 0;
+	case GL_DEBUG_SEVERITY_MEDIUM:
+		return 1;
+	case GL_DEBUG_SEVERITY_LOW:
+		return 2;
+	default:
+		return 3;
+	}
+}
+
+static const char* errorString(GLenum status)
+{
+	switch (status)
+	{
+	case GL_INVALID_ENUM:
+		return "GL_INVALID_ENUM";
+	case GL_INVALID_VALUE:
+		return "GL_INVALID_VALUE";
+	case GL_INVALID_OPERATION:
+		return "GL_INVALID_OPERATION";
+	case GL_INVALID_FRAMEBUFFER_OPERATION:
+		return "GL_INVALID_FRAMEBUFFER_OPERATION";
+	case GL_OUT_OF_MEMORY:
+		return "GL_OUT_OF_MEMORY";
+	default:
+		return "GL_UNKNOWN_ERROR";
+	}
+}
+
+static void recordMessage(GLenum source, GLenum type, GLuint id, GLenum severity, const char* text)
+{
+	// a call repeated in a loop between two checkpoints reports the same message every time
+	for (size_t p = debugMessages.size() - numPendingMessages; p < debugMessages.size(); ++p)
+	{
+		GLDebugMessage& pending = debugMessages[p];
+		if (pending.id == id && pending.text == text)
+		{
+			pending.count++;
+			return;
+		}
+	}
+
+	if (debugMessages.size() - numPendingMessages >= maxDebugMessages || numPendingMessages >= maxPendingMessages)
+	{
+		numDroppedMessages++;
+		return;
+	}
+
+	GLDebugMessage message;
+	message.source = source;
+	message.type = type;
+	message.id = id;
+	message.severity = severity;
+	message.text = text;
+	message.file = nullptr;
+	message.line = 0;
+	message.count = 1;
+
+	debugMessages.push_back(message);
+	numPendingMessages++;
+}
+
+// assign the pending messages to a location, repeated messages only bump the count of the first one
+static void resolvePending(const char* file, int line)
+{
+	size_t firstPending = debugMessages.size() - numPendingMessages;
+	for (size_t p = firstPending; p < debugMessages.size(); ++p)
+	{
+		GLDebugMessage& message = debugMessages[p];
+		message.file = file;
+		message.line = line;
+
+		bool duplicate = false;
+		for (size_t m = 0; m < firstPending && !duplicate; ++m)
+		{
+			GLDebugMessage& known = debugMessages[m];
+			if (known.id == message.id && known.line == line && known.file == file && known.text == message.text)
+			{
+				known.count += message.count;
+				duplicate = true;
+			}
+		}
+
+		if (duplicate)
+			continue;
+
+		// report new errors right away, everything shows up in the report
+		if (message.severity == GL_DEBUG_SEVERITY_HIGH)
+			fprintf(stderr, "%s:%d: OpenGL error: %s\n", file ? file : "?", line, message.text.c_str());
+
+		debugMessages[firstPending++] = message;
+	}
+
+	debugMessages.resize(firstPending);
+	numPendingMessages = 0;
+}
+
+static void GLAPIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
+{
+	recordMessage(source, type, id, severity, message);
+}
+
+void glDebugCheckpoint(const char* file, int line)
+{
+	if (!debugOutputActive)
+	{
+		for (GLenum status = glGetError(); status != GL_NO_ERROR; status = glGetError())
+			recordMessage(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_ERROR, status, GL_DEBUG_SEVERITY_HIGH, errorString(status));
+	}
+
+	if (numPendingMessages)
+		resolvePending(file, line);
+}
+
+void initGLDebugOutput()
+{
+	GLint contextFlags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &contextFlags);
+
+	if (!(contextFlags & GL_CONTEXT_FLAG_DEBUG_BIT) || !(GLEW_KHR_debug || GLEW_VERSION_4_3))
+	{
+		printf("gl debug output: not available, polling glGetError\n");
+		return;
+	}
+
+	// synchronous delivery so a message belongs to the call that caused it
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(debugMessageCallback, nullptr);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+
+	debugOutputActive = true;
+	printf("gl debug output: KHR_debug callback\n");
+}
+
+static bool messageOrder(const GLDebugMessage& a, const GLDebugMessage& b)
+{
+	if (severityRank(a.severity) != severityRank(b.severity))
+		return severityRank(a.severity) < severityRank(b.severity);
+
+	int files = std::string(a.file ? a.file : "").compare(b.file ? b.file : "");
+	if (files != 0)
+		return files < 0;
+
+	return a.line < b.line;
+}
+
+void printGLDebugReport()
+{
+	resolvePending(nullptr, 0);
+
+	if (debugMessages.empty())
+		return;
+
+	std::sort(debugMessages.begin(), debugMessages.end(), messageOrder);
+
+	printf("gl debug messages:\n");
+	for (size_t m = 0; m < debugMessages.size(); ++m)
+	{
+		const GLDebugMessage& message = debugMessages[m];
+		printf("  [%s] %s:%d (x%u) %s\n", severityString(message.severity), message.file ? message.file : "?", message.line, message.count, message.text.c_str());
+	}
+
+	if (numDroppedMessages)
+		printf("  %u further messages dropped\n", numDroppedMessages);
+}
+
+#endif
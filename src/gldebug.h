@@ -0,0 +1,35 @@
+#ifndef GLDEBUG_H
+#define GLDEBUG_H
+
+#include <GL/glew.h>
+
+// debug builds route gl errors through KHR_debug when the context is a debug context and fall back
+// to glGetError polling otherwise, release builds compile all of it away
+#ifdef NDEBUG
+
+#define CHECK_GL ((void)0)
+
+inline void initGLDebugOutput()
+{
+}
+
+inline void printGLDebugReport()
+{
+}
+
+#else
+
+// messages reported since the previous checkpoint are attributed to this source location
+#define CHECK_GL glDebugCheckpoint(__FILE__, __LINE__)
+
+void glDebugCheckpoint(const char* file, int line);
+
+// call once after glewInit, registers the message callback if the context supports it
+void initGLDebugOutput();
+
+// every distinct message with its count, sorted by severity and source location
+void printGLDebugReport();
+
+#endif
+
+#endif
@@ -1,12 +1,49 @@
 #include "glmeshdata.h"
+#include "glstats.h"
+#include "glstatecache.h"
+#include "glmeshoptimizer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+// round to nearest, values below the smallest normal half flush to zero
+static GLhalf floatToHalf(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent <= 0)
+		return static_cast<GLhalf>(sign);
+	if (exponent >= 31)
+		return static_cast<GLhalf>(sign | 0x7c00);
+
+	// a mantissa carry correctly bumps the exponent
+	uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++;
+
+	return static_cast<GLhalf>(half);
+}
 
 GLMeshData::GLMeshData()
 {
-	meshVAID = meshVBID_pos = meshVBID_uv = meshIBID = 0;
+	meshVAID = meshVBID_pos = meshVBID_uv = meshVBID_vertex = meshVBID_instance = meshIBID = 0;
 
 	numVertices = numPrimitives = 0;
+	instanceCapacity = 0;
 
+	vertexFormat = GLVertexFormat::Interleaved;
+	overdrawOptimization = false;
 	primitiveType = GL_TRIANGLES;
+	indexType = GL_UNSIGNED_INT;
 }
 
 GLMeshData::~GLMeshData()
@@ -18,29 +55,55 @@ void GLMeshData::clear()
 {
 	if (meshVBID_pos)
 	{
-		glDeleteBuffers(1, &meshVBID_pos);
+		g_gl_state.deleteBuffer(meshVBID_pos);
 		meshVBID_pos = 0;
 	}
 
 	if (meshVBID_uv)
 	{
-		glDeleteBuffers(1, &meshVBID_uv);
+		g_gl_state.deleteBuffer(meshVBID_uv);
 		meshVBID_uv = 0;
 	}
 
+	if (meshVBID_vertex)
+	{
+		g_gl_state.deleteBuffer(meshVBID_vertex);
+		meshVBID_vertex = 0;
+	}
+
+	if (meshVBID_instance)
+	{
+		g_gl_state.deleteBuffer(meshVBID_instance);
+		meshVBID_instance = 0;
+		instanceCapacity = 0;
+	}
+
 	if (meshIBID)
 	{
-		glDeleteBuffers(1, &meshIBID);
+		g_gl_state.deleteBuffer(meshIBID);
 		meshIBID = 0;
 	}
 
 	if (meshVAID)
 	{
-		glDeleteVertexArrays(1, &meshVAID);
+		g_gl_state.deleteVertexArray(meshVAID);
 		meshVAID = 0;
 	}
 }
 
+void GLMeshData::setVertexFormat(GLVertexFormat format)
+{
+	vertexFormat = format;
+}
+
+size_t GLMeshData::getBufferSize() const
+{
+	size_t vertexSize = vertexFormat == GLVertexFormat::Interleaved ? sizeof(GLPackedVertex) : 5 * sizeof(GLfloat);
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+	return vertexSize * numVertices + indexSize * indexData.size();
+}
+
 void GLMeshData::createPlane(float base, float size, float uvScale)
 {
 	numPrimitives = 2;
@@ -209,67 +272,462 @@ void GLMeshData::createSphere(float rad, uint32_t hSegs, uint32_t vSegs)
 	createGLObjects();
 }
 
+void GLMeshData::createIcosphere(float rad, uint32_t subdivisions)
+{
+	// icosahedron, every subdivision splits each triangle into four at the edge midpoints pushed onto the sphere
+	const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+	std::vector<GLfloat> unitPos = {
+		-1.0f,  t, 0.0f,   1.0f,  t, 0.0f,  -1.0f, -t, 0.0f,   1.0f, -t, 0.0f,
+		0.0f, -1.0f,  t,   0.0f, 1.0f,  t,   0.0f, -1.0f, -t,   0.0f, 1.0f, -t,
+		 t, 0.0f, -1.0f,    t, 0.0f, 1.0f,   -t, 0.0f, -1.0f,   -t, 0.0f, 1.0f
+	};
+	for (size_t i = 0; i < unitPos.size(); i += 3)
+	{
+		float len = std::sqrt(unitPos[i] * unitPos[i] + unitPos[i + 1] * unitPos[i + 1] + unitPos[i + 2] * unitPos[i + 2]);
+		unitPos[i] /= len;
+		unitPos[i + 1] /= len;
+		unitPos[i + 2] /= len;
+	}
+
+	std::vector<GLuint> triangles = {
+		0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+		1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+		3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+		4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+	};
+
+	for (uint32_t s = 0; s < subdivisions; ++s)
+	{
+		// edges shared by two triangles get one midpoint
+		std::map<std::pair<GLuint, GLuint>, GLuint> midpoints;
+		auto midpoint = [&](GLuint a, GLuint b)
+		{
+			std::pair<GLuint, GLuint> edge(std::min(a, b), std::max(a, b));
+			auto it = midpoints.find(edge);
+			if (it != midpoints.end())
+				return it->second;
+
+			float x = unitPos[3 * a] + unitPos[3 * b];
+			float y = unitPos[3 * a + 1] + unitPos[3 * b + 1];
+			float z = unitPos[3 * a + 2] + unitPos[3 * b + 2];
+			float len = std::sqrt(x * x + y * y + z * z);
+			unitPos.insert(unitPos.end(), { x / len, y / len, z / len });
+
+			GLuint index = static_cast<GLuint>(unitPos.size() / 3 - 1);
+			midpoints[edge] = index;
+			return index;
+		};
+
+		std::vector<GLuint> subdivided;
+		subdivided.reserve(triangles.size() * 4);
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			GLuint a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+			GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+
+			subdivided.insert(subdivided.end(), { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca });
+		}
+		triangles.swap(subdivided);
+	}
+
+	// same spherical uv mapping as createSphere, without a seam column the wrapping triangles stretch
+	// across the texture, which only shows up close by where the uv sphere is drawn instead
+	for (size_t i = 0; i < unitPos.size(); i += 3)
+	{
+		float x = unitPos[i], y = unitPos[i + 1], z = unitPos[i + 2];
+		float phi = std::atan2(z, x);
+		if (phi < 0.0f)
+			phi += (float)(2.0*M_PI);
+
+		posData.insert(posData.end(), { rad * x, rad * y, rad * z });
+		uvData.insert(uvData.end(), { 1.0f - phi / (float)(2.0*M_PI), std::acos(std::max(-1.0f, std::min(1.0f, y))) / (float)(M_PI) });
+	}
+
+	indexData = triangles;
+	numPrimitives = static_cast<unsigned int>(triangles.size() / 3);
+
+	createGLObjects();
+}
+
+void GLMeshData::createCapsule(float rad, float halfHeight, uint32_t hSegs, uint32_t vSegs, int upAxis)
+{
+	// sphere rings split at the equator, upper hemisphere moved up and lower one moved down by halfHeight
+	vSegs += vSegs % 2;
+
+	float dphi = (float)(2.0*M_PI) / (float)(hSegs);
+	float dtheta = (float)(M_PI) / (float)(vSegs);
+
+	uint32_t numRows = vSegs + 2;
+	for (uint32_t r = 0; r < numRows; ++r)
+	{
+		uint32_t v = (r <= vSegs / 2) ? r : r - 1;
+		float theta = v * dtheta;
+		float offset = (r <= vSegs / 2) ? halfHeight : -halfHeight;
+
+		for (uint32_t h = 0; h <= hSegs; ++h)
+		{
+			float phi = h * dphi;
+
+			float x = std::sin(theta) * std::cos(phi);
+			float y = std::cos(theta);
+			float z = std::sin(theta) * std::sin(phi);
+
+			posData.insert(posData.end(), { rad * x, rad * y + offset, rad * z });
+			uvData.insert(uvData.end(), { 1.0f - (float)h / hSegs, (float)r / (numRows - 1) });
+		}
+	}
+
+	for (uint32_t r = 0; r < numRows - 1; r++)
+	{
+		for (uint32_t h = 0; h < hSegs; h++)
+		{
+			uint32_t topRight = r * (hSegs + 1) + h;
+			uint32_t topLeft = r * (hSegs + 1) + h + 1;
+			uint32_t lowerRight = (r + 1) * (hSegs + 1) + h;
+			uint32_t lowerLeft = (r + 1) * (hSegs + 1) + h + 1;
+
+			indexData.insert(indexData.end(), { lowerLeft, lowerRight, topRight });
+			indexData.insert(indexData.end(), { lowerLeft, topRight, topLeft });
+		}
+	}
+
+	numPrimitives = static_cast<unsigned int>(indexData.size() / 3);
+
+	alignToUpAxis(upAxis);
+	createGLObjects();
+}
+
+void GLMeshData::createCylinder(float rad, float halfHeight, uint32_t hSegs, int upAxis)
+{
+	float dphi = (float)(2.0*M_PI) / (float)(hSegs);
+
+	// side wall, top ring followed by bottom ring
+	for (uint32_t v = 0; v < 2; ++v)
+	{
+		float y = (v == 0) ? halfHeight : -halfHeight;
+
+		for (uint32_t h = 0; h <= hSegs; ++h)
+		{
+			float phi = h * dphi;
+
+			posData.insert(posData.end(), { rad * std::cos(phi), y, rad * std::sin(phi) });
+			uvData.insert(uvData.end(), { 1.0f - (float)h / hSegs, (float)v });
+		}
+	}
+
+	for (uint32_t h = 0; h < hSegs; h++)
+	{
+		uint32_t topRight = h;
+		uint32_t topLeft = h + 1;
+		uint32_t lowerRight = (hSegs + 1) + h;
+		uint32_t lowerLeft = (hSegs + 1) + h + 1;
+
+		indexData.insert(indexData.end(), { lowerLeft, lowerRight, topRight });
+		indexData.insert(indexData.end(), { lowerLeft, topRight, topLeft });
+	}
+
+	// caps, center vertex followed by its own ring so the cap gets planar uvs
+	for (uint32_t c = 0; c < 2; ++c)
+	{
+		float y = (c == 0) ? halfHeight : -halfHeight;
+		uint32_t center = static_cast<uint32_t>(posData.size() / 3);
+
+		posData.insert(posData.end(), { 0.0f, y, 0.0f });
+		uvData.insert(uvData.end(), { 0.5f, 0.5f });
+
+		for (uint32_t h = 0; h <= hSegs; ++h)
+		{
+			float phi = h * dphi;
+
+			posData.insert(posData.end(), { rad * std::cos(phi), y, rad * std::sin(phi) });
+			uvData.insert(uvData.end(), { 0.5f + 0.5f * std::cos(phi), 0.5f + 0.5f * std::sin(phi) });
+		}
+
+		for (uint32_t h = 0; h < hSegs; h++)
+		{
+			if (c == 0)
+				indexData.insert(indexData.end(), { center, center + h + 2, center + h + 1 });
+			else
+				indexData.insert(indexData.end(), { center, center + h + 1, center + h + 2 });
+		}
+	}
+
+	numPrimitives = static_cast<unsigned int>(indexData.size() / 3);
+
+	alignToUpAxis(upAxis);
+	createGLObjects();
+}
+
+void GLMeshData::createCone(float rad, float height, uint32_t hSegs, int upAxis)
+{
+	float dphi = (float)(2.0*M_PI) / (float)(hSegs);
+	float halfHeight = 0.5f * height;
+
+	// side, one apex vertex per segment so every slice gets its own uv
+	for (uint32_t h = 0; h <= hSegs; ++h)
+	{
+		float phi = h * dphi;
+
+		posData.insert(posData.end(), { 0.0f, halfHeight, 0.0f });
+		uvData.insert(uvData.end(), { 1.0f - (float)h / hSegs, 0.0f });
+
+		posData.insert(posData.end(), { rad * std::cos(phi), -halfHeight, rad * std::sin(phi) });
+		uvData.insert(uvData.end(), { 1.0f - (float)h / hSegs, 1.0f });
+	}
+
+	for (uint32_t h = 0; h < hSegs; h++)
+	{
+		uint32_t apex = 2 * h;
+		uint32_t lowerRight = 2 * h + 1;
+		uint32_t lowerLeft = 2 * h + 3;
+
+		indexData.insert(indexData.end(), { lowerLeft, lowerRight, apex });
+	}
+
+	// base cap
+	uint32_t center = static_cast<uint32_t>(posData.size() / 3);
+
+	posData.insert(posData.end(), { 0.0f, -halfHeight, 0.0f });
+	uvData.insert(uvData.end(), { 0.5f, 0.5f });
+
+	for (uint32_t h = 0; h <= hSegs; ++h)
+	{
+		float phi = h * dphi;
+
+		posData.insert(posData.end(), { rad * std::cos(phi), -halfHeight, rad * std::sin(phi) });
+		uvData.insert(uvData.end(), { 0.5f + 0.5f * std::cos(phi), 0.5f + 0.5f * std::sin(phi) });
+	}
+
+	for (uint32_t h = 0; h < hSegs; h++)
+	{
+		indexData.insert(indexData.end(), { center, center + h + 1, center + h + 2 });
+	}
+
+	numPrimitives = static_cast<unsigned int>(indexData.size() / 3);
+
+	alignToUpAxis(upAxis);
+	createGLObjects();
+}
+
+void GLMeshData::alignToUpAxis(int upAxis)
+{
+	// meshes are generated y-up, rotate them (keeping the winding) onto the requested axis
+	for (size_t i = 0; i + 2 < posData.size(); i += 3)
+	{
+		float x = posData[i + 0];
+		float y = posData[i + 1];
+		float z = posData[i + 2];
+
+		if (upAxis == 0)
+		{
+			posData[i + 0] = y;
+			posData[i + 1] = -x;
+		}
+		else if (upAxis == 2)
+		{
+			posData[i + 1] = -z;
+			posData[i + 2] = y;
+		}
+	}
+}
+
+static bool reportOptimization = false;
+
+void GLMeshData::setOptimizationReport(bool enabled)
+{
+	reportOptimization = enabled;
+}
+
+void GLMeshData::optimizeIndices()
+{
+	float acmrBefore = computeACMR(indexData, numVertices);
+
+	std::vector<size_t> clusterStarts;
+	optimizeVertexCache(indexData, numVertices, 16, overdrawOptimization ? &clusterStarts : nullptr);
+	if (overdrawOptimization)
+		optimizeOverdraw(indexData, posData, clusterStarts);
+
+	// vertices in first use order, so fetches walk the vertex buffer mostly forward
+	std::vector<GLuint> remap;
+	optimizeVertexFetch(indexData, numVertices, remap);
+	remapVertexAttribute(posData, 3, remap);
+	remapVertexAttribute(uvData, 2, remap);
+
+	if (reportOptimization)
+		printf("mesh: %u triangles, %u vertices, acmr %.3f -> %.3f\n", numPrimitives, numVertices, acmrBefore, computeACMR(indexData, numVertices));
+}
+
 void GLMeshData::createGLObjects()
 {
-	// create vertex buffer objects for pos, uv
-	glGenBuffers(1, &meshVBID_pos);
-	glBindBuffer(GL_ARRAY_BUFFER, meshVBID_pos);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * posData.size(), posData.data(), GL_STATIC_DRAW);
-	CHECK_GL;
+	numVertices = static_cast<unsigned int>(posData.size() / 3);
 
-	glGenBuffers(1, &meshVBID_uv);
-	glBindBuffer(GL_ARRAY_BUFFER, meshVBID_uv);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * uvData.size(), uvData.data(), GL_STATIC_DRAW);
+	if (primitiveType == GL_TRIANGLES)
+		optimizeIndices();
+
+	GLuint loc_pos = 0;
+	GLuint los_uv = 1;
+	GLuint loc_instance_albedo = 3;
+	GLuint loc_instance_model = 4; // mat4 occupies locations 4-7
+
+	// create vertex array
+	glGenVertexArrays(1, &meshVAID);
+	g_gl_state.bindVertexArray(meshVAID);
 	CHECK_GL;
 
-	// create index buffer object
+	if (vertexFormat == GLVertexFormat::Interleaved)
+	{
+		std::vector<GLPackedVertex> vertices(numVertices);
+		for (unsigned int v = 0; v < numVertices; ++v)
+		{
+			GLPackedVertex& vertex = vertices[v];
+			vertex.pos[0] = posData[3 * v + 0];
+			vertex.pos[1] = posData[3 * v + 1];
+			vertex.pos[2] = posData[3 * v + 2];
+			vertex.uv[0] = floatToHalf(uvData[2 * v + 0]);
+			vertex.uv[1] = floatToHalf(uvData[2 * v + 1]);
+		}
+
+		// create one vertex buffer object for pos, uv
+		glGenBuffers(1, &meshVBID_vertex);
+		g_gl_state.bindBuffer(GL_ARRAY_BUFFER, meshVBID_vertex);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLPackedVertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+		CHECK_GL;
+
+		glVertexAttribPointer(loc_pos, 3, GL_FLOAT, GL_FALSE, sizeof(GLPackedVertex), (void*)offsetof(GLPackedVertex, pos));
+		glVertexAttribPointer(los_uv, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(GLPackedVertex), (void*)offsetof(GLPackedVertex, uv));
+		CHECK_GL;
+
+		glEnableVertexAttribArray(loc_pos);
+		glEnableVertexAttribArray(los_uv);
+		CHECK_GL;
+	}
+	else
+	{
+		// create vertex buffer objects for pos, uv
+		glGenBuffers(1, &meshVBID_pos);
+		g_gl_state.bindBuffer(GL_ARRAY_BUFFER, meshVBID_pos);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * posData.size(), posData.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(loc_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		CHECK_GL;
+
+		glGenBuffers(1, &meshVBID_uv);
+		g_gl_state.bindBuffer(GL_ARRAY_BUFFER, meshVBID_uv);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * uvData.size(), uvData.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(los_uv, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		CHECK_GL;
+
+		glEnableVertexAttribArray(loc_pos);
+		glEnableVertexAttribArray(los_uv);
+		CHECK_GL;
+	}
+
+	// create index buffer object, 16 bit indices whenever the vertex count allows
 	glGenBuffers(1, &meshIBID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIBID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indexData.size(), indexData.data(), GL_STATIC_DRAW);
-	CHECK_GL;
+	g_gl_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIBID);
+	if (numVertices <= 0x10000)
+	{
+		std::vector<GLushort> shortIndices(indexData.begin(), indexData.end());
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		indexType = GL_UNSIGNED_SHORT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * shortIndices.size(), shortIndices.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indexData.size(), indexData.data(), GL_STATIC_DRAW);
+	}
 	CHECK_GL;
 
-	// create vertex array
-	glGenVertexArrays(1, &meshVAID);
-	glBindVertexArray(meshVAID);
+	// create an empty per-instance vertex buffer, filled by setInstanceData
+	glGenBuffers(1, &meshVBID_instance);
+	setInstanceAttributes(meshVBID_instance, 0);
+
+	glEnableVertexAttribArray(loc_instance_albedo);
+	glVertexAttribDivisor(loc_instance_albedo, 1);
+	for (GLuint c = 0; c < 4; ++c)
+	{
+		glEnableVertexAttribArray(loc_instance_model + c);
+		glVertexAttribDivisor(loc_instance_model + c, 1);
+	}
 	CHECK_GL;
 
-	GLuint loc_pos = 0;
-	GLuint los_uv = 1;
+	// the element buffer binding is part of the vertex array, unbind it so later binds do not modify it
+	g_gl_state.bindVertexArray(0);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshIBID);
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, 0);
+	g_gl_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	CHECK_GL;
+}
+
+void GLMeshData::setInstanceAttributes(GLuint buffer, GLintptr offset)
+{
+	GLuint loc_instance_albedo = 3;
+	GLuint loc_instance_model = 4; // mat4 occupies locations 4-7
 
-	glBindBuffer(GL_ARRAY_BUFFER, meshVBID_pos);
-	glVertexAttribPointer(loc_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	glBindBuffer(GL_ARRAY_BUFFER, meshVBID_uv);
-	glVertexAttribPointer(los_uv, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(loc_instance_albedo, 4, GL_FLOAT, GL_FALSE, sizeof(GLInstanceData), (void*)(offset + offsetof(GLInstanceData, albedo)));
+	for (GLuint c = 0; c < 4; ++c)
+		glVertexAttribPointer(loc_instance_model + c, 4, GL_FLOAT, GL_FALSE, sizeof(GLInstanceData), (void*)(offset + offsetof(GLInstanceData, model) + sizeof(GLfloat) * 4 * c));
 	CHECK_GL;
+}
 
-	glEnableVertexAttribArray(loc_pos);
-	glEnableVertexAttribArray(los_uv);
+void GLMeshData::render()
+{
+	g_gl_state.bindVertexArray(meshVAID);
 	CHECK_GL;
 
-	glBindVertexArray(0);
+	glDrawElements(primitiveType, 3 * numPrimitives, indexType, (void*)0);
+	CHECK_GL;
+	g_gl_stats.drawCalls++;
+	g_gl_stats.primitivesDrawn += numPrimitives;
+}
 
-	glDisableVertexAttribArray(loc_pos);
-	glDisableVertexAttribArray(los_uv);
+void GLMeshData::setInstanceData(const GLInstanceData* data, unsigned int count)
+{
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, meshVBID_instance);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// orphan the previous storage so the driver does not stall on in-flight draws
+	if (count > instanceCapacity)
+	{
+		instanceCapacity = count;
+	}
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLInstanceData) * instanceCapacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLInstanceData) * count, data);
 	CHECK_GL;
+	g_gl_stats.bufferUploads++;
 }
 
-void GLMeshData::render()
+void GLMeshData::renderInstanced(unsigned int count)
 {
-	glBindVertexArray(meshVAID);
+	if (count == 0)
+		return;
+
+	g_gl_state.bindVertexArray(meshVAID);
+	CHECK_GL;
+
+	setInstanceAttributes(meshVBID_instance, 0);
+
+	glDrawElementsInstanced(primitiveType, 3 * numPrimitives, indexType, (void*)0, count);
 	CHECK_GL;
+	g_gl_stats.drawCalls++;
+	g_gl_stats.instancesDrawn += count;
+	g_gl_stats.primitivesDrawn += numPrimitives * count;
+}
+
+void GLMeshData::renderInstanced(unsigned int count, GLuint instanceBuffer, GLintptr instanceOffset)
+{
+	if (count == 0)
+		return;
 
-	glDrawElements(primitiveType, 3 * numPrimitives, GL_UNSIGNED_INT, (void*)0);
+	g_gl_state.bindVertexArray(meshVAID);
 	CHECK_GL;
 
-	glBindVertexArray(0);
+	// every draw, see GLRingBuffer
+	setInstanceAttributes(instanceBuffer, instanceOffset);
+
+	glDrawElementsInstanced(primitiveType, 3 * numPrimitives, indexType, (void*)0, count);
 	CHECK_GL;
-}
\ No newline at end of file
+	g_gl_stats.drawCalls++;
+	g_gl_stats.instancesDrawn += count;
+	g_gl_stats.primitivesDrawn += numPrimitives * count;
+}
@@ -7,35 +7,32 @@
 #include <cmath>
 #include <vector>
 #include <string>
-#include <sstream>
-#include <iostream>
 
-#define CHECK_GL { GLenum glStatus = glGetError(); if( glStatus != GL_NO_ERROR ) { std::cout << "File: " << __FILE__ << " " << "Line: " << __LINE__ << " " << "OpenGL error: " << openglGetErrorString( glStatus ); } }
-static std::string openglGetErrorString(GLenum status)
+#include "gldebug.h"
+
+// vertex buffer layout, selected with setVertexFormat before the mesh is created
+enum class GLVertexFormat
 {
-	std::stringstream ss;
+	// float positions and uvs in two buffers
+	Separate,
+	// single buffer of GLPackedVertex
+	Interleaved
+};
 
-	switch (status)
-	{
-	case GL_INVALID_ENUM:
-		ss << "GL_INVALID_ENUM";
-		break;
-	case GL_INVALID_VALUE:
-		ss << "GL_INVALID_VALUE";
-		break;
-	case GL_INVALID_OPERATION:
-		ss << "GL_INVALID_OPERATION";
-		break;
-	case GL_OUT_OF_MEMORY:
-		ss << "GL_OUT_OF_MEMORY";
-		break;
-	default:
-		ss << "GL_UNKNOWN_ERROR" << " - " << status;
-		break;
-	}
+// 16 bytes per vertex instead of 20 for the Separate float layout: float position (location 0)
+// and half float uv (location 1)
+struct GLPackedVertex
+{
+	GLfloat pos[3];
+	GLhalf uv[2];
+};
 
-	return ss.str();
-}
+// per-instance vertex attributes, column-major model matrix followed by rgba albedo
+struct GLInstanceData
+{
+	GLfloat model[16];
+	GLfloat albedo[4];
+};
 
 class GLMeshData
 {
@@ -46,14 +43,63 @@ public:
 	void createBox(float w, float h, float l);
 	void createPlane(float base, float size, float uvScale = 1.0f);
 	void createSphere(float rad, uint32_t hSegs, uint32_t vSegs);
+	// 20 * 4^subdivisions evenly sized triangles, cheaper than a uv sphere of similar silhouette
+	void createIcosphere(float rad, uint32_t subdivisions);
+
+	// Bullet convention: shapes are centered at the origin and aligned with upAxis (0 = x, 1 = y, 2 = z)
+	void createCapsule(float rad, float halfHeight, uint32_t hSegs, uint32_t vSegs, int upAxis = 1);
+	void createCylinder(float rad, float halfHeight, uint32_t hSegs, int upAxis = 1);
+	void createCone(float rad, float height, uint32_t hSegs, int upAxis = 1);
+
+	// half float uvs lose precision above a few hundred, keep Separate for large uv scales
+	void setVertexFormat(GLVertexFormat format);
+
+	// also sort the triangle clusters for less overdraw when the mesh is created, off by default
+	void setOverdrawOptimization(bool enabled)
+	{
+		overdrawOptimization = enabled;
+	}
+
+	// print the vertex cache miss ratio before and after optimization for every mesh created
+	static void setOptimizationReport(bool enabled);
 
 	void render();
 	void clear();
 
+	// size of the static vertex and index buffers in bytes
+	size_t getBufferSize() const;
+
+	unsigned int getNumPrimitives() const
+	{
+		return numPrimitives;
+	}
+
+	GLuint getVertexArray() const
+	{
+		return meshVAID;
+	}
+
+	// upload per-instance attributes and draw the mesh count times with a single call
+	void setInstanceData(const GLInstanceData* data, unsigned int count);
+	void renderInstanced(unsigned int count);
+
+	// draw with count GLInstanceData read from an external buffer at offset, e.g. a GLRingBuffer allocation
+	void renderInstanced(unsigned int count, GLuint instanceBuffer, GLintptr instanceOffset);
+
 protected:
 	void createGLObjects();
 
+	// reorder triangles for the post-transform vertex cache (and overdraw), then the vertices to match
+	void optimizeIndices();
+	void alignToUpAxis(int upAxis);
+
+	// point the per-instance attributes at buffer and offset, the vertex array must be bound
+	void setInstanceAttributes(GLuint buffer, GLintptr offset);
+
+	GLVertexFormat vertexFormat;
+	bool overdrawOptimization;
 	GLenum primitiveType;
+	GLenum indexType;
 	unsigned int numVertices;
 	unsigned int numPrimitives;
 
@@ -61,6 +107,10 @@ protected:
 	GLuint meshIBID;
 	GLuint meshVBID_pos;
 	GLuint meshVBID_uv;
+	GLuint meshVBID_vertex;
+	GLuint meshVBID_instance;
+
+	unsigned int instanceCapacity;
 	
 	std::vector<GLuint> indexData;
 	std::vector<GLfloat> posData;
@@ -0,0 +1,69 @@
+#include "glmeshlod.h"
+#include "glmeshdata.h"
+
+GLMeshLodChain::GLMeshLodChain()
+	: hysteresis(0.15f)
+{
+}
+
+GLMeshLodChain::~GLMeshLodChain()
+{
+	clear();
+}
+
+void GLMeshLodChain::addLevel(GLMeshData* mesh, float minRadius)
+{
+	if (meshes.size() == MaxLevels)
+	{
+		delete mesh;
+		return;
+	}
+
+	meshes.push_back(mesh);
+	minScreenRadius.push_back(minRadius);
+}
+
+void GLMeshLodChain::createSphere(float rad)
+{
+	clear();
+
+	GLMeshData* mesh = new GLMeshData;
+	mesh->createSphere(rad, 32, 32);
+	addLevel(mesh, 40.0f);
+
+	mesh = new GLMeshData;
+	mesh->createSphere(rad, 16, 16);
+	addLevel(mesh, 12.0f);
+
+	mesh = new GLMeshData;
+	mesh->createSphere(rad, 8, 8);
+	addLevel(mesh, 4.0f);
+
+	mesh = new GLMeshData;
+	mesh->createIcosphere(rad, 1);
+	addLevel(mesh, 0.0f);
+}
+
+void GLMeshLodChain::clear()
+{
+	for (size_t i = 0; i < meshes.size(); ++i)
+		delete meshes[i];
+
+	meshes.clear();
+	minScreenRadius.clear();
+}
+
+int GLMeshLodChain::selectLevel(float screenRadius, int current) const
+{
+	int last = getNumLevels() - 1;
+	int level = current < last ? current : last;
+
+	// finer levels once the radius is clearly above their minimum, coarser ones once clearly below the current one
+	while (level > 0 && screenRadius >= minScreenRadius[level - 1] * (1.0f + hysteresis))
+		level--;
+
+	while (level < last && screenRadius < minScreenRadius[level] * (1.0f - hysteresis))
+		level++;
+
+	return level;
+}
@@ -0,0 +1,54 @@
+#ifndef GLMESHLOD_H
+#define GLMESHLOD_H
+
+#include <vector>
+
+class GLMeshData;
+
+// meshes of decreasing detail for one shape, a level is drawn while the projected radius (in pixels)
+// is at least its minimum. levels only change once the radius is past the threshold by the hysteresis
+// fraction, so instances hovering around a threshold don't flicker between two levels
+class GLMeshLodChain
+{
+public:
+	enum { MaxLevels = 4 };
+
+	GLMeshLodChain();
+	~GLMeshLodChain();
+
+	// takes ownership of mesh, levels are added from the most detailed one on
+	void addLevel(GLMeshData* mesh, float minScreenRadius);
+
+	// 32, 16 and 8 segment uv spheres followed by a once subdivided icosphere
+	void createSphere(float rad);
+
+	void clear();
+
+	int getNumLevels() const
+	{
+		return static_cast<int>(meshes.size());
+	}
+
+	GLMeshData* getMesh(int level) const
+	{
+		return meshes[level];
+	}
+
+	void setHysteresis(float fraction)
+	{
+		hysteresis = fraction;
+	}
+
+	// level for a projected radius given the level the instance was drawn with last time
+	int selectLevel(float screenRadius, int current) const;
+
+private:
+	std::vector<GLMeshData*> meshes;
+	std::vector<float> minScreenRadius;
+	float hysteresis;
+
+	GLMeshLodChain(const GLMeshLodChain& that);
+	GLMeshLodChain& operator=(const GLMeshLodChain& that);
+};
+
+#endif
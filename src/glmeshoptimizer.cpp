@@ -0,0 +1,260 @@
+#include "glmeshoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+float computeACMR(const std::vector<GLuint>& indices, unsigned int numVertices, unsigned int cacheSize)
+{
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return 0.0f;
+
+	// fifo cache, a vertex is in cache while fewer than cacheSize misses happened since its own
+	std::vector<size_t> missedAt(numVertices, 0);
+	size_t misses = 0;
+
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		GLuint v = indices[i];
+		if (missedAt[v] == 0 || misses + 1 - missedAt[v] > cacheSize)
+		{
+			misses++;
+			missedAt[v] = misses;
+		}
+	}
+
+	return float(misses) / float(numTriangles);
+}
+
+void optimizeVertexCache(std::vector<GLuint>& indices, unsigned int numVertices, unsigned int cacheSize, std::vector<size_t>* clusterStarts)
+{
+	size_t numTriangles = indices.size() / 3;
+	if (clusterStarts)
+		clusterStarts->assign(1, 0);
+
+	if (numTriangles == 0)
+		return;
+
+	// triangles adjacent to each vertex, packed
+	std::vector<int> liveTriangles(numVertices, 0);
+	for (size_t i = 0; i < indices.size(); ++i)
+		liveTriangles[indices[i]]++;
+
+	std::vector<size_t> adjacencyOffset(numVertices + 1, 0);
+	for (unsigned int v = 0; v < numVertices; ++v)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+
+	std::vector<size_t> adjacency(indices.size());
+	std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<size_t> cacheTime(numVertices, 0);
+	std::vector<unsigned char> emitted(numTriangles, 0);
+	std::vector<GLuint> deadEnds;
+	std::vector<GLuint> candidates;
+
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+
+	size_t time = cacheSize + 1;
+	unsigned int cursor = 0;
+	long fanning = indices[0];
+
+	while (fanning >= 0)
+	{
+		// emit all remaining triangles around the fanning vertex
+		candidates.clear();
+		for (size_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a)
+		{
+			size_t t = adjacency[a];
+			if (emitted[t])
+				continue;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				GLuint v = indices[3 * t + c];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = 1;
+		}
+
+		// next fanning vertex: the oldest candidate that will still be in cache after its remaining triangles
+		long next = -1;
+		long bestPriority = -1;
+		for (size_t c = 0; c < candidates.size(); ++c)
+		{
+			GLuint v = candidates[c];
+			if (liveTriangles[v] <= 0)
+				continue;
+
+			long priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = static_cast<long>(time - cacheTime[v]);
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0)
+		{
+			// dead end, go back to recently used vertices first, then scan for any vertex with triangles left
+			while (!deadEnds.empty() && next < 0)
+			{
+				GLuint v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[v] > 0)
+					next = v;
+			}
+
+			while (next < 0 && cursor < numVertices)
+			{
+				if (liveTriangles[cursor] > 0)
+					next = cursor;
+				else
+					cursor++;
+			}
+
+			if (next >= 0 && clusterStarts)
+				clusterStarts->push_back(output.size() / 3);
+		}
+
+		fanning = next;
+	}
+
+	indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<GLfloat>& positions, const std::vector<size_t>& clusterStarts)
+{
+	size_t numTriangles = indices.size() / 3;
+	size_t numClusters = clusterStarts.size();
+	if (numClusters < 2)
+		return;
+
+	// area weighted centroid and normal of each cluster, and of the whole mesh
+	struct Cluster
+	{
+		size_t begin, end;
+		float centroid[3];
+		float normal[3];
+		float area;
+		float score;
+	};
+
+	std::vector<Cluster> clusters(numClusters);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < numClusters; ++c)
+	{
+		Cluster& cluster = clusters[c];
+		cluster.begin = clusterStarts[c];
+		cluster.end = c + 1 < numClusters ? clusterStarts[c + 1] : numTriangles;
+		cluster.centroid[0] = cluster.centroid[1] = cluster.centroid[2] = 0.0f;
+		cluster.normal[0] = cluster.normal[1] = cluster.normal[2] = 0.0f;
+		cluster.area = 0.0f;
+
+		for (size_t t = cluster.begin; t < cluster.end; ++t)
+		{
+			const GLfloat* p0 = &positions[3 * indices[3 * t + 0]];
+			const GLfloat* p1 = &positions[3 * indices[3 * t + 1]];
+			const GLfloat* p2 = &positions[3 * indices[3 * t + 2]];
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				cluster.centroid[k] += area * (p0[k] + p1[k] + p2[k]) / 3.0f;
+				cluster.normal[k] += n[k];
+			}
+			cluster.area += area;
+		}
+
+		for (int k = 0; k < 3; ++k)
+			meshCentroid[k] += cluster.centroid[k];
+		meshArea += cluster.area;
+
+		if (cluster.area > 0.0f)
+		{
+			for (int k = 0; k < 3; ++k)
+				cluster.centroid[k] /= cluster.area;
+		}
+	}
+
+	if (meshArea > 0.0f)
+	{
+		for (int k = 0; k < 3; ++k)
+			meshCentroid[k] /= meshArea;
+	}
+
+	// occlusion potential, how far the cluster faces out of the mesh
+	for (size_t c = 0; c < numClusters; ++c)
+	{
+		Cluster& cluster = clusters[c];
+		float len = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+
+		cluster.score = 0.0f;
+		if (len > 0.0f)
+		{
+			for (int k = 0; k < 3; ++k)
+				cluster.score += (cluster.centroid[k] - meshCentroid[k]) * cluster.normal[k] / len;
+		}
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.score > b.score; });
+
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	for (size_t c = 0; c < numClusters; ++c)
+		output.insert(output.end(), indices.begin() + 3 * clusters[c].begin, indices.begin() + 3 * clusters[c].end);
+
+	indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<GLuint>& indices, unsigned int numVertices, std::vector<GLuint>& remap)
+{
+	// unreferenced vertices keep their relative order behind the referenced ones
+	const GLuint unused = ~GLuint(0);
+	remap.assign(numVertices, unused);
+
+	GLuint next = 0;
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		if (remap[indices[i]] == unused)
+			remap[indices[i]] = next++;
+	}
+
+	for (unsigned int v = 0; v < numVertices; ++v)
+	{
+		if (remap[v] == unused)
+			remap[v] = next++;
+	}
+
+	for (size_t i = 0; i < indices.size(); ++i)
+		indices[i] = remap[indices[i]];
+}
+
+void remapVertexAttribute(std::vector<GLfloat>& data, unsigned int components, const std::vector<GLuint>& remap)
+{
+	if (data.size() != remap.size() * components)
+		return;
+
+	std::vector<GLfloat> remapped(data.size());
+	for (size_t v = 0; v < remap.size(); ++v)
+		std::copy(data.begin() + v * components, data.begin() + (v + 1) * components, remapped.begin() + remap[v] * components);
+
+	data.swap(remapped);
+}
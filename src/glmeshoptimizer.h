@@ -0,0 +1,30 @@
+#ifndef GLMESHOPTIMIZER_H
+#define GLMESHOPTIMIZER_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <vector>
+
+// triangle list reordering for the post-transform vertex cache, overdraw and vertex fetch,
+// all functions work on indexed triangle lists
+
+// average cache miss ratio, vertices transformed per triangle with a fifo cache of cacheSize entries
+// (0.5 is the limit for large regular grids, 3 means no reuse at all)
+float computeACMR(const std::vector<GLuint>& indices, unsigned int numVertices, unsigned int cacheSize = 16);
+
+// Tipsify (Sander, Nehab and Barczak 2007): fans around the most recently used vertices that are still
+// in cache. clusterStarts receives the first triangle of every run started after a dead end, if not null
+void optimizeVertexCache(std::vector<GLuint>& indices, unsigned int numVertices, unsigned int cacheSize = 16, std::vector<size_t>* clusterStarts = nullptr);
+
+// sort the clusters of optimizeVertexCache so the ones facing away from the mesh center, which are
+// likely to occlude the rest, are drawn first. the cache order inside each cluster is kept
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<GLfloat>& positions, const std::vector<size_t>& clusterStarts);
+
+// renumber vertices in the order the indices first use them, remap receives the new index of every old vertex
+void optimizeVertexFetch(std::vector<GLuint>& indices, unsigned int numVertices, std::vector<GLuint>& remap);
+
+// move every components-wide attribute to its remapped position
+void remapVertexAttribute(std::vector<GLfloat>& data, unsigned int components, const std::vector<GLuint>& remap);
+
+#endif
@@ -0,0 +1,150 @@
+#include "glrenderqueue.h"
+#include "glmeshdata.h"
+#include "glsphereimpostors.h"
+#include "glstatecache.h"
+
+#include <algorithm>
+#include <cstring>
+
+GLRenderQueue::GLRenderQueue()
+	: depthPrepass(false), overdrawQuery(false), samplesQuery(0), queryPending(false)
+{
+}
+
+GLRenderQueue::~GLRenderQueue()
+{
+	clear();
+}
+
+void GLRenderQueue::clear()
+{
+	if (samplesQuery)
+	{
+		glDeleteQueries(1, &samplesQuery);
+		samplesQuery = 0;
+	}
+
+	items.clear();
+	queryPending = false;
+}
+
+GLDrawItem GLRenderQueue::makeItem(GLuint program, GLuint texture)
+{
+	GLDrawItem item;
+	memset(&item, 0, sizeof(item));
+
+	item.program = program;
+	item.texture = texture;
+	item.modelLocation = -1;
+	item.colorLocation = -1;
+
+	return item;
+}
+
+uint64_t GLRenderQueue::makeKey(GLuint program, GLuint texture, GLuint vertexArray, float viewDepth)
+{
+	// the bits of a non negative float sort like its value. dropping the sign and the low 7 mantissa bits
+	// keeps the 8 exponent and top 16 mantissa bits, the same relative precision at every distance
+	uint32_t depthBits;
+	float depth = viewDepth > 0.0f ? viewDepth : 0.0f;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	uint64_t key = 0;
+	key |= uint64_t(program & 0xFF) << 56;
+	key |= uint64_t(texture & 0xFF) << 48;
+	key |= uint64_t((depthBits >> 7) & 0xFFFFFF) << 24;
+	key |= uint64_t(vertexArray & 0xFFFFFF);
+
+	return key;
+}
+
+void GLRenderQueue::submit(GLDrawItem item, float viewDepth)
+{
+	GLuint vertexArray = item.mesh ? item.mesh->getVertexArray() : (item.impostors ? item.impostors->getVertexArray() : 0);
+	item.key = makeKey(item.program, item.texture, vertexArray, viewDepth);
+
+	items.push_back(item);
+}
+
+void GLRenderQueue::draw(const GLDrawItem& item) const
+{
+	g_gl_state.useProgram(item.program);
+	if (item.texture)
+		g_gl_state.bindTexture(0, GL_TEXTURE_2D, item.texture);
+
+	if (item.modelLocation >= 0)
+		g_gl_state.uniformMatrix4fv(item.modelLocation, item.model);
+	if (item.colorLocation >= 0)
+		g_gl_state.uniform3fv(item.colorLocation, item.color);
+
+	if (item.impostors)
+	{
+		if (item.instanceBuffer)
+			item.impostors->renderInstanced(item.instanceCount, item.instanceBuffer, item.instanceOffset);
+		else
+			item.impostors->renderInstanced(item.instanceCount);
+	}
+	else if (item.mesh)
+	{
+		if (item.instanceCount == 0)
+			item.mesh->render();
+		else if (item.instanceBuffer)
+			item.mesh->renderInstanced(item.instanceCount, item.instanceBuffer, item.instanceOffset);
+		else
+			item.mesh->renderInstanced(item.instanceCount);
+	}
+}
+
+void GLRenderQueue::flush()
+{
+	// equal keys keep their submission order
+	std::stable_sort(items.begin(), items.end(), [](const GLDrawItem& a, const GLDrawItem& b) { return a.key < b.key; });
+
+	if (depthPrepass)
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		for (size_t i = 0; i < items.size(); ++i)
+			draw(items[i]);
+
+		// the color pass only shades the surviving fragments
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);
+	}
+
+	if (overdrawQuery)
+	{
+		if (!samplesQuery)
+			glGenQueries(1, &samplesQuery);
+
+		glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+	}
+
+	for (size_t i = 0; i < items.size(); ++i)
+		draw(items[i]);
+
+	if (overdrawQuery)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		queryPending = true;
+	}
+
+	if (depthPrepass)
+	{
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+
+	items.clear();
+}
+
+GLuint GLRenderQueue::readSamplesPassed()
+{
+	if (!queryPending)
+		return 0;
+
+	GLuint samples = 0;
+	glGetQueryObjectuiv(samplesQuery, GL_QUERY_RESULT, &samples);
+
+	return samples;
+}
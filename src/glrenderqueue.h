@@ -0,0 +1,97 @@
+#ifndef GLRENDERQUEUE_H
+#define GLRENDERQUEUE_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+class GLMeshData;
+class GLSphereImpostors;
+
+// one opaque draw, recorded during the frame and issued by GLRenderQueue::flush in key order
+struct GLDrawItem
+{
+	uint64_t key;
+
+	GLuint program;
+	// bound to unit 0 as GL_TEXTURE_2D when non zero
+	GLuint texture;
+
+	// either a mesh or impostors
+	GLMeshData* mesh;
+	GLSphereImpostors* impostors;
+
+	// 0 draws the mesh once without instancing, instance buffer 0 uses the mesh's own one
+	unsigned int instanceCount;
+	GLuint instanceBuffer;
+	GLintptr instanceOffset;
+
+	// uniforms of a non instanced draw, negative locations are skipped, the values must stay valid until flush
+	GLint modelLocation;
+	const GLfloat* model;
+	GLint colorLocation;
+	const GLfloat* color;
+};
+
+// sorts the frame's opaque draws by program, then texture, then front to back by view depth, with the
+// vertex array last (state changes are worth more than depth order, depth order more than a vao bind).
+// optionally lays down depth first so the color pass shades every pixel once, and counts the samples
+// the color pass wrote with an occlusion query as the frame's overdraw
+class GLRenderQueue
+{
+public:
+	GLRenderQueue();
+	~GLRenderQueue();
+
+	// item with everything but the draw itself cleared
+	static GLDrawItem makeItem(GLuint program, GLuint texture = 0);
+
+	// 64 bit key: program (8 bits), texture (8), quantized view depth (24), vertex array (24)
+	static uint64_t makeKey(GLuint program, GLuint texture, GLuint vertexArray, float viewDepth);
+
+	// computes the item's key from its state and viewDepth, the distance of its closest point to the eye
+	void submit(GLDrawItem item, float viewDepth);
+
+	// sort and issue every submitted item, the queue is empty afterwards
+	void flush();
+
+	void setDepthPrepass(bool enabled)
+	{
+		depthPrepass = enabled;
+	}
+
+	bool getDepthPrepass() const
+	{
+		return depthPrepass;
+	}
+
+	// count the samples passing the depth test in the color pass of every flush
+	void setOverdrawQuery(bool enabled)
+	{
+		overdrawQuery = enabled;
+	}
+
+	// samples written by the last flush's color pass, waits for the gpu
+	GLuint readSamplesPassed();
+
+	// release the query object, must be called while the gl context is current
+	void clear();
+
+protected:
+	void draw(const GLDrawItem& item) const;
+
+	std::vector<GLDrawItem> items;
+
+	bool depthPrepass;
+	bool overdrawQuery;
+	GLuint samplesQuery;
+	bool queryPending;
+
+private:
+	GLRenderQueue(const GLRenderQueue& that);
+	GLRenderQueue& operator=(const GLRenderQueue& that);
+};
+
+#endif
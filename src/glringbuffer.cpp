@@ -0,0 +1,175 @@
+#include "glringbuffer.h"
+#include "glstatecache.h"
+#include "glstats.h"
+#include "gldebug.h"
+
+GLRingBuffer::GLRingBuffer()
+	: target(GL_ARRAY_BUFFER), bufferID(0), persistent(false), mapped(nullptr), segmentSize(0), numSegments(0), currentSegment(0), head(0)
+{
+	for (int s = 0; s < MaxSegments; ++s)
+		fences[s] = 0;
+}
+
+void GLRingBuffer::deleteRetiredBuffers()
+{
+	// the draws reading them have been issued, gl keeps the storage alive until they are done
+	for (size_t i = 0; i < retiredBuffers.size(); ++i)
+		g_gl_state.deleteBuffer(retiredBuffers[i]);
+
+	retiredBuffers.clear();
+}
+
+GLRingBuffer::~GLRingBuffer()
+{
+	clear();
+}
+
+void GLRingBuffer::create(GLenum bufferTarget, GLsizeiptr size, int segments)
+{
+	target = bufferTarget;
+	segmentSize = (size + Alignment - 1) & ~GLsizeiptr(Alignment - 1);
+	numSegments = segments < 1 ? 1 : (segments > MaxSegments ? MaxSegments : segments);
+	persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+
+	createStorage();
+}
+
+void GLRingBuffer::createStorage()
+{
+	GLsizeiptr capacity = segmentSize * numSegments;
+
+	glGenBuffers(1, &bufferID);
+	g_gl_state.bindBuffer(target, bufferID);
+
+	if (persistent)
+	{
+		// coherent, so writes are visible to draws issued afterwards without explicit flushes
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, capacity, NULL, flags);
+		mapped = static_cast<char*>(glMapBufferRange(target, 0, capacity, flags));
+	}
+	else
+	{
+		glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+	}
+	CHECK_GL;
+
+	currentSegment = 0;
+	head = 0;
+}
+
+void GLRingBuffer::deleteFences()
+{
+	for (int s = 0; s < MaxSegments; ++s)
+	{
+		if (fences[s])
+		{
+			glDeleteSync(fences[s]);
+			fences[s] = 0;
+		}
+	}
+}
+
+void GLRingBuffer::clear()
+{
+	deleteFences();
+	deleteRetiredBuffers();
+
+	if (bufferID)
+	{
+		// deleting a buffer unmaps it
+		g_gl_state.deleteBuffer(bufferID);
+		bufferID = 0;
+		mapped = nullptr;
+	}
+}
+
+void GLRingBuffer::waitForSegment(int segment)
+{
+	if (!fences[segment])
+		return;
+
+	// flush once so the fence is guaranteed to signal, then block in steps of 1 ms
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(fences[segment], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+		flags = 0;
+
+	glDeleteSync(fences[segment]);
+	fences[segment] = 0;
+}
+
+void GLRingBuffer::beginFrame()
+{
+	currentSegment = (currentSegment + 1) % numSegments;
+	head = 0;
+
+	waitForSegment(currentSegment);
+}
+
+void GLRingBuffer::endFrame()
+{
+	if (fences[currentSegment])
+		glDeleteSync(fences[currentSegment]);
+
+	fences[currentSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	deleteRetiredBuffers();
+}
+
+GLRingBuffer::Allocation GLRingBuffer::allocate(GLsizeiptr size)
+{
+	size = (size + Alignment - 1) & ~GLsizeiptr(Alignment - 1);
+
+	if (head + size > segmentSize)
+	{
+		// segment overflow, size the segments for this frame's load
+		while (segmentSize < head + size)
+			segmentSize *= 2;
+
+		// draws queued earlier in the frame hold the old name and offsets into its storage, so neither
+		// delete nor orphan it before they are issued
+		if (persistent)
+		{
+			g_gl_state.bindBuffer(target, bufferID);
+			glUnmapBuffer(target);
+			mapped = nullptr;
+		}
+		retiredBuffers.push_back(bufferID);
+
+		// the fences guarded the old storage, the new buffer starts at the current segment
+		int segment = currentSegment;
+		deleteFences();
+		createStorage();
+		currentSegment = segment;
+	}
+
+	Allocation allocation;
+	allocation.offset = segmentSize * currentSegment + head;
+	head += size;
+
+	if (persistent)
+	{
+		allocation.ptr = mapped + allocation.offset;
+	}
+	else
+	{
+		// the fence of this segment has been waited for, no synchronization needed
+		g_gl_state.bindBuffer(target, bufferID);
+		allocation.ptr = glMapBufferRange(target, allocation.offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		CHECK_GL;
+	}
+
+	g_gl_stats.bufferUploads++;
+
+	return allocation;
+}
+
+void GLRingBuffer::commit()
+{
+	if (!persistent)
+	{
+		g_gl_state.bindBuffer(target, bufferID);
+		glUnmapBuffer(target);
+		CHECK_GL;
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef GLRINGBUFFER_H
+#define GLRINGBUFFER_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// streaming buffer split into one segment per frame in flight, each segment is guarded by a fence.
+// with GL_ARB_buffer_storage the buffer is mapped once persistently and coherently, on plain GL 3.3
+// every allocation maps its range unsynchronized. a segment overflow moves to a new, larger buffer, the
+// old one keeps its contents and name until endFrame so draws queued earlier in the frame still read it.
+// users point their vertex attributes at the buffer and offset of every allocation: gl 3.3 has no base
+// instance, and an unchanged name proves nothing as names are recycled once their buffer is deleted
+class GLRingBuffer
+{
+public:
+	struct Allocation
+	{
+		void* ptr;
+		GLintptr offset;
+	};
+
+	GLRingBuffer();
+	~GLRingBuffer();
+
+	void create(GLenum target, GLsizeiptr segmentSize, int numSegments = 3);
+	void clear();
+
+	// wait until the gpu is done with the segment this frame writes to
+	void beginFrame();
+	// fence the segment written this frame and release buffers replaced during it, queued draws using
+	// allocations of this frame must have been issued before
+	void endFrame();
+
+	// write pointer and buffer offset for size bytes, valid until commit
+	Allocation allocate(GLsizeiptr size);
+	// must follow every allocate before the data is used by a draw
+	void commit();
+
+	GLuint getBufferID() const
+	{
+		return bufferID;
+	}
+
+	bool isPersistent() const
+	{
+		return persistent;
+	}
+
+private:
+	enum { MaxSegments = 4, Alignment = 256 };
+
+	void createStorage();
+	void deleteFences();
+	void waitForSegment(int segment);
+
+	GLenum target;
+	GLuint bufferID;
+	bool persistent;
+	char* mapped;
+
+	GLsizeiptr segmentSize;
+	int numSegments;
+	int currentSegment;
+	GLsizeiptr head;
+
+	GLsync fences[MaxSegments];
+
+	// replaced by an overflow this frame, deleted in endFrame. segments double on each overflow, so the
+	// list stays short
+	std::vector<GLuint> retiredBuffers;
+
+	void deleteRetiredBuffers();
+
+	GLRingBuffer(const GLRingBuffer& that);
+	GLRingBuffer& operator=(const GLRingBuffer& that);
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "glsphereimpostors.h"
+#include "gldebug.h"
+#include "glstats.h"
+#include "glstatecache.h"
+
+#include <cstddef>
+
+static const GLuint loc_corner = 0;
+static const GLuint loc_instance_center = 1;
+static const GLuint loc_instance_albedo = 2;
+
+GLSphereImpostors::GLSphereImpostors()
+	: quadVAID(0), quadVBID(0), instanceVBID(0), instanceCapacity(0)
+{
+}
+
+GLSphereImpostors::~GLSphereImpostors()
+{
+	clear();
+}
+
+void GLSphereImpostors::create()
+{
+	clear();
+
+	// quad corners in units of the silhouette radius, drawn as a triangle strip
+	const GLfloat corners[] = { -1.0f, -1.0f,  1.0f, -1.0f,  -1.0f, 1.0f,  1.0f, 1.0f };
+
+	glGenVertexArrays(1, &quadVAID);
+	g_gl_state.bindVertexArray(quadVAID);
+	CHECK_GL;
+
+	glGenBuffers(1, &quadVBID);
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, quadVBID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glVertexAttribPointer(loc_corner, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(loc_corner);
+	CHECK_GL;
+
+	// create an empty per-instance vertex buffer, filled by setInstanceData
+	glGenBuffers(1, &instanceVBID);
+	setInstanceAttributes(instanceVBID, 0);
+
+	glEnableVertexAttribArray(loc_instance_center);
+	glVertexAttribDivisor(loc_instance_center, 1);
+	glEnableVertexAttribArray(loc_instance_albedo);
+	glVertexAttribDivisor(loc_instance_albedo, 1);
+	CHECK_GL;
+
+	g_gl_state.bindVertexArray(0);
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GLSphereImpostors::clear()
+{
+	if (quadVBID)
+	{
+		g_gl_state.deleteBuffer(quadVBID);
+		quadVBID = 0;
+	}
+
+	if (instanceVBID)
+	{
+		g_gl_state.deleteBuffer(instanceVBID);
+		instanceVBID = 0;
+		instanceCapacity = 0;
+	}
+
+	if (quadVAID)
+	{
+		g_gl_state.deleteVertexArray(quadVAID);
+		quadVAID = 0;
+	}
+}
+
+void GLSphereImpostors::setInstanceAttributes(GLuint buffer, GLintptr offset)
+{
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(loc_instance_center, 4, GL_FLOAT, GL_FALSE, sizeof(GLImpostorData), (void*)(offset + offsetof(GLImpostorData, centerRadius)));
+	glVertexAttribPointer(loc_instance_albedo, 4, GL_FLOAT, GL_FALSE, sizeof(GLImpostorData), (void*)(offset + offsetof(GLImpostorData, albedo)));
+	CHECK_GL;
+}
+
+void GLSphereImpostors::setInstanceData(const GLImpostorData* data, unsigned int count)
+{
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, instanceVBID);
+
+	// orphan the previous storage so the driver does not stall on in-flight draws
+	if (count > instanceCapacity)
+	{
+		instanceCapacity = count;
+	}
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLImpostorData) * instanceCapacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLImpostorData) * count, data);
+	CHECK_GL;
+	g_gl_stats.bufferUploads++;
+}
+
+void GLSphereImpostors::renderInstanced(unsigned int count)
+{
+	renderInstanced(count, instanceVBID, 0);
+}
+
+void GLSphereImpostors::renderInstanced(unsigned int count, GLuint instanceBuffer, GLintptr instanceOffset)
+{
+	if (count == 0)
+		return;
+
+	g_gl_state.bindVertexArray(quadVAID);
+	CHECK_GL;
+
+	// every draw, see GLRingBuffer
+	setInstanceAttributes(instanceBuffer, instanceOffset);
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+	CHECK_GL;
+	g_gl_stats.drawCalls++;
+	g_gl_stats.instancesDrawn += count;
+	g_gl_stats.primitivesDrawn += 2 * count;
+}
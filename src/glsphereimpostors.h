@@ -0,0 +1,54 @@
+#ifndef GLSPHEREIMPOSTORS_H
+#define GLSPHEREIMPOSTORS_H
+
+// Include GLEW
+#include <GL/glew.h>
+
+// per-instance attributes of an impostor, world space center and radius followed by rgba albedo
+struct GLImpostorData
+{
+	GLfloat centerRadius[4];
+	GLfloat albedo[4];
+};
+
+// spheres drawn as one quad each, facing the eye and sized to the sphere's silhouette. the fragment
+// shader intersects the view ray with the sphere, discards misses and writes the hit's depth, so the
+// result matches a tessellated sphere at any distance with 4 vertices per instance.
+// drawn with the impostor program (shaders/Impostor*), which reads the Camera uniform block
+class GLSphereImpostors
+{
+public:
+	GLSphereImpostors();
+	~GLSphereImpostors();
+
+	void create();
+	void clear();
+
+	GLuint getVertexArray() const
+	{
+		return quadVAID;
+	}
+
+	// upload per-instance attributes and draw count impostors with a single call
+	void setInstanceData(const GLImpostorData* data, unsigned int count);
+	void renderInstanced(unsigned int count);
+
+	// draw count GLImpostorData read from an external buffer at offset, e.g. a GLRingBuffer allocation
+	void renderInstanced(unsigned int count, GLuint instanceBuffer, GLintptr instanceOffset);
+
+protected:
+	// point the per-instance attributes at buffer and offset, the vertex array must be bound
+	void setInstanceAttributes(GLuint buffer, GLintptr offset);
+
+	GLuint quadVAID;
+	GLuint quadVBID;
+	GLuint instanceVBID;
+
+	unsigned int instanceCapacity;
+
+private:
+	GLSphereImpostors(const GLSphereImpostors& that);
+	GLSphereImpostors& operator=(const GLSphereImpostors& that);
+};
+
+#endif
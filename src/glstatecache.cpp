@@ -0,0 +1,245 @@
+#include "glstatecache.h"
+#include "glstats.h"
+
+#include <cstring>
+
+// never a valid gl name, marks a binding as unknown
+static const GLuint unknownBinding = ~0u;
+
+GLStateCache g_gl_state;
+
+GLStateCache::GLStateCache()
+{
+	invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+	program = vertexArray = arrayBuffer = elementBuffer = uniformBuffer = unknownBinding;
+
+	activeUnit = unknownBinding;
+	for (int u = 0; u < MaxTextureUnits; ++u)
+	{
+		textureTargets[u] = 0;
+		textures[u] = unknownBinding;
+	}
+
+	programUniforms.clear();
+	currentUniforms = nullptr;
+}
+
+void GLStateCache::useProgram(GLuint newProgram)
+{
+	if (program == newProgram)
+	{
+		g_gl_stats.skippedStateChanges++;
+		return;
+	}
+
+	glUseProgram(newProgram);
+	program = newProgram;
+
+	currentUniforms = nullptr;
+	for (size_t p = 0; p < programUniforms.size(); ++p)
+	{
+		if (programUniforms[p].program == newProgram)
+			currentUniforms = &programUniforms[p];
+	}
+
+	if (!currentUniforms && newProgram)
+	{
+		ProgramUniforms entry;
+		entry.program = newProgram;
+		programUniforms.push_back(entry);
+		currentUniforms = &programUniforms.back();
+	}
+}
+
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+	if (vertexArray == vao)
+	{
+		g_gl_stats.skippedStateChanges++;
+		return;
+	}
+
+	glBindVertexArray(vao);
+	vertexArray = vao;
+
+	// the element buffer binding belongs to the vertex array
+	elementBuffer = unknownBinding;
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint* binding = nullptr;
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+		binding = &arrayBuffer;
+		break;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		binding = &elementBuffer;
+		break;
+	case GL_UNIFORM_BUFFER:
+		binding = &uniformBuffer;
+		break;
+	}
+
+	if (binding && *binding == buffer)
+	{
+		g_gl_stats.skippedStateChanges++;
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	if (binding)
+		*binding = buffer;
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	if (unit < MaxTextureUnits && textureTargets[unit] == target && textures[unit] == texture)
+	{
+		g_gl_stats.skippedStateChanges++;
+		return;
+	}
+
+	if (activeUnit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+	}
+
+	glBindTexture(target, texture);
+	if (unit < MaxTextureUnits)
+	{
+		textureTargets[unit] = target;
+		textures[unit] = texture;
+	}
+}
+
+bool GLStateCache::updateUniform(GLint location, const GLfloat* values, GLint size)
+{
+	if (location < 0 || !currentUniforms)
+		return true;
+
+	std::vector<CachedUniform>& uniforms = currentUniforms->uniforms;
+	for (size_t u = 0; u < uniforms.size(); ++u)
+	{
+		CachedUniform& uniform = uniforms[u];
+		if (uniform.location != location)
+			continue;
+
+		if (uniform.size == size && memcmp(uniform.values, values, sizeof(GLfloat) * size) == 0)
+		{
+			g_gl_stats.skippedStateChanges++;
+			return false;
+		}
+
+		uniform.size = size;
+		memcpy(uniform.values, values, sizeof(GLfloat) * size);
+		return true;
+	}
+
+	CachedUniform uniform;
+	uniform.location = location;
+	uniform.size = size;
+	memcpy(uniform.values, values, sizeof(GLfloat) * size);
+	uniforms.push_back(uniform);
+
+	return true;
+}
+
+void GLStateCache::uniform1i(GLint location, GLint value)
+{
+	// compared bitwise, the int is stored in a float slot
+	GLfloat bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	if (updateUniform(location, &bits, 1))
+	{
+		glUniform1i(location, value);
+		g_gl_stats.uniformUploads++;
+	}
+}
+
+void GLStateCache::uniform3fv(GLint location, const GLfloat* value)
+{
+	if (updateUniform(location, value, 3))
+	{
+		glUniform3fv(location, 1, value);
+		g_gl_stats.uniformUploads++;
+	}
+}
+
+void GLStateCache::uniform4fv(GLint location, const GLfloat* value)
+{
+	if (updateUniform(location, value, 4))
+	{
+		glUniform4fv(location, 1, value);
+		g_gl_stats.uniformUploads++;
+	}
+}
+
+void GLStateCache::uniformMatrix4fv(GLint location, const GLfloat* value)
+{
+	if (updateUniform(location, value, 16))
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, value);
+		g_gl_stats.uniformUploads++;
+	}
+}
+
+void GLStateCache::deleteProgram(GLuint deleted)
+{
+	glDeleteProgram(deleted);
+
+	// a deleted program stays in use until another one is bound, only the uniform cache is dropped
+	for (size_t p = 0; p < programUniforms.size(); ++p)
+	{
+		if (programUniforms[p].program == deleted)
+		{
+			programUniforms.erase(programUniforms.begin() + p);
+			break;
+		}
+	}
+
+	currentUniforms = nullptr;
+	program = unknownBinding;
+}
+
+void GLStateCache::deleteVertexArray(GLuint vao)
+{
+	glDeleteVertexArrays(1, &vao);
+
+	if (vertexArray == vao)
+		vertexArray = 0;
+}
+
+void GLStateCache::deleteBuffer(GLuint buffer)
+{
+	glDeleteBuffers(1, &buffer);
+
+	if (arrayBuffer == buffer)
+		arrayBuffer = 0;
+	if (uniformBuffer == buffer)
+		uniformBuffer = 0;
+
+	// may have been bound to a vertex array that is not current
+	elementBuffer = unknownBinding;
+}
+
+void GLStateCache::deleteTextures(GLsizei n, const GLuint* deleted)
+{
+	glDeleteTextures(n, deleted);
+
+	for (GLsizei i = 0; i < n; ++i)
+	{
+		for (int u = 0; u < MaxTextureUnits; ++u)
+		{
+			if (textures[u] == deleted[i])
+				textures[u] = 0;
+		}
+	}
+}
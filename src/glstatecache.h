@@ -0,0 +1,72 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// shadows the bound program, vertex array, buffers, textures and uniform values and skips calls that
+// would not change any state, skipped calls are counted in g_gl_stats.
+// raw gl calls that touch the same state must be followed by invalidate()
+class GLStateCache
+{
+public:
+	GLStateCache();
+
+	// forget everything, the next call of each kind always reaches gl
+	void invalidate();
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	// GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER (part of the vertex array state) and GL_UNIFORM_BUFFER, other targets pass through
+	void bindBuffer(GLenum target, GLuint buffer);
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	// uniform values are cached per program and location, for the currently used program
+	void uniform1i(GLint location, GLint value);
+	void uniform3fv(GLint location, const GLfloat* value);
+	void uniform4fv(GLint location, const GLfloat* value);
+	void uniformMatrix4fv(GLint location, const GLfloat* value);
+
+	// delete and drop the objects from the cache so reused names are not mistaken for bound ones
+	void deleteProgram(GLuint program);
+	void deleteVertexArray(GLuint vao);
+	void deleteBuffer(GLuint buffer);
+	void deleteTextures(GLsizei n, const GLuint* textures);
+
+private:
+	enum { MaxTextureUnits = 16, MaxUniformFloats = 16 };
+
+	struct CachedUniform
+	{
+		GLint location;
+		GLint size;
+		GLfloat values[MaxUniformFloats];
+	};
+
+	struct ProgramUniforms
+	{
+		GLuint program;
+		std::vector<CachedUniform> uniforms;
+	};
+
+	// true if the value differs from the cached one (and caches it)
+	bool updateUniform(GLint location, const GLfloat* values, GLint size);
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint arrayBuffer;
+	GLuint elementBuffer;
+	GLuint uniformBuffer;
+
+	GLuint activeUnit;
+	GLenum textureTargets[MaxTextureUnits];
+	GLuint textures[MaxTextureUnits];
+
+	std::vector<ProgramUniforms> programUniforms;
+	ProgramUniforms* currentUniforms;
+};
+
+extern GLStateCache g_gl_state;
+
+#endif
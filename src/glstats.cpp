@@ -0,0 +1,3 @@
+#include "glstats.h"
+
+GLFrameStats g_gl_stats = { 0, 0, 0, 0, 0, 0 };
@@ -0,0 +1,24 @@
+#ifndef GLSTATS_H
+#define GLSTATS_H
+
+// cpu side submission counters, reset by the application once per frame
+struct GLFrameStats
+{
+	unsigned int drawCalls;
+	unsigned int uniformUploads;
+	unsigned int bufferUploads;
+	unsigned int instancesDrawn;
+	unsigned int primitivesDrawn;
+
+	// calls GLStateCache dropped because they would not have changed any state
+	unsigned int skippedStateChanges;
+
+	void reset()
+	{
+		drawCalls = uniformUploads = bufferUploads = instancesDrawn = primitivesDrawn = skippedStateChanges = 0;
+	}
+};
+
+extern GLFrameStats g_gl_stats;
+
+#endif
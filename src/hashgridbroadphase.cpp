@@ -0,0 +1,502 @@
+#include "hashgridbroadphase.h"
+
+#include "LinearMath/btAabbUtil2.h"
+#include "LinearMath/btThreads.h"
+
+#include <cmath>
+#include <stdio.h>
+
+// cell coordinates are packed into 20 bits per axis, the level into the top bits
+static const int CellCoordBits = 20;
+static const int CellCoordLimit = (1 << (CellCoordBits - 1)) - 1;
+
+static unsigned long long packCellKey(int level, int x, int y, int z)
+{
+	const unsigned long long mask = (1ull << CellCoordBits) - 1;
+	return (static_cast<unsigned long long>(level) << (3 * CellCoordBits))
+		| ((static_cast<unsigned long long>(x + CellCoordLimit + 1) & mask) << (2 * CellCoordBits))
+		| ((static_cast<unsigned long long>(y + CellCoordLimit + 1) & mask) << CellCoordBits)
+		| (static_cast<unsigned long long>(z + CellCoordLimit + 1) & mask);
+}
+
+static void unpackCellKey(unsigned long long key, int& level, int* cell)
+{
+	const unsigned long long mask = (1ull << CellCoordBits) - 1;
+	level = static_cast<int>(key >> (3 * CellCoordBits));
+	cell[0] = static_cast<int>((key >> (2 * CellCoordBits)) & mask) - CellCoordLimit - 1;
+	cell[1] = static_cast<int>((key >> CellCoordBits) & mask) - CellCoordLimit - 1;
+	cell[2] = static_cast<int>(key & mask) - CellCoordLimit - 1;
+}
+
+static int getCellCoord(btScalar value, btScalar cellSize)
+{
+	btScalar cell = btFloor(value / cellSize);
+	return static_cast<int>(btClamped(cell, btScalar(-CellCoordLimit), btScalar(CellCoordLimit)));
+}
+
+static bool isInCellRange(const int* cell, const int* cellMin, const int* cellMax)
+{
+	return cell[0] >= cellMin[0] && cell[0] <= cellMax[0]
+		&& cell[1] >= cellMin[1] && cell[1] <= cellMax[1]
+		&& cell[2] >= cellMin[2] && cell[2] <= cellMax[2];
+}
+
+// call visit(cell, proxies) for every occupied cell of the level in the range. large ranges walk the
+// occupied cells instead of looking up every cell of the range
+template <typename Visit>
+static void forEachCell(const HashGridBroadphase::CellMap& cells, int level, const int* cellMin, const int* cellMax, Visit visit)
+{
+	double volume = 1.0;
+	for (int i = 0; i < 3; ++i)
+		volume *= static_cast<double>(cellMax[i] - cellMin[i] + 1);
+
+	if (volume > static_cast<double>(cells.size()))
+	{
+		for (HashGridBroadphase::CellMap::const_iterator it = cells.begin(); it != cells.end(); ++it)
+		{
+			int cellLevel;
+			int cell[3];
+			unpackCellKey(it->first, cellLevel, cell);
+			if (cellLevel == level && isInCellRange(cell, cellMin, cellMax))
+				visit(cell, it->second);
+		}
+		return;
+	}
+
+	int cell[3];
+	for (cell[0] = cellMin[0]; cell[0] <= cellMax[0]; ++cell[0])
+	{
+		for (cell[1] = cellMin[1]; cell[1] <= cellMax[1]; ++cell[1])
+		{
+			for (cell[2] = cellMin[2]; cell[2] <= cellMax[2]; ++cell[2])
+			{
+				HashGridBroadphase::CellMap::const_iterator it = cells.find(packCellKey(level, cell[0], cell[1], cell[2]));
+				if (it != cells.end())
+					visit(cell, it->second);
+			}
+		}
+	}
+}
+
+// a pair is reported by the moved proxy with the lower uid if both moved
+static bool reportsPairWith(const HashGridProxy* proxy, const HashGridProxy* other)
+{
+	return other != proxy && (other->movedIndex < 0 || proxy->m_uniqueId < other->m_uniqueId);
+}
+
+HashGridBroadphase::HashGridBroadphase(btScalar cellSize, int numLevels, btOverlappingPairCache* pairCache)
+	: pairCache(pairCache), ownsPairCache(pairCache == nullptr), numLevels(btMax(1, btMin(numLevels, static_cast<int>(MaxLevels)))), nextUid(0), cleanupCursor(0), numPairsToCheck(0)
+{
+	if (ownsPairCache)
+		this->pairCache = new btHashedOverlappingPairCache();
+
+	for (int i = 0; i < MaxLevels; ++i)
+	{
+		cellSizes[i] = cellSize * btScalar(1 << i);
+		numProxiesPerLevel[i] = 0;
+	}
+}
+
+HashGridBroadphase::~HashGridBroadphase()
+{
+	for (int i = 0; i < proxies.size(); ++i)
+		delete proxies[i];
+
+	if (ownsPairCache)
+		delete pairCache;
+}
+
+void HashGridBroadphase::getCellRangeOnLevel(int level, const btVector3& aabbMin, const btVector3& aabbMax, int* cellMin, int* cellMax) const
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		cellMin[i] = getCellCoord(aabbMin[i], cellSizes[level]);
+		cellMax[i] = getCellCoord(aabbMax[i], cellSizes[level]);
+	}
+}
+
+bool HashGridBroadphase::getCellRange(const btVector3& aabbMin, const btVector3& aabbMax, int& level, int* cellMin, int* cellMax) const
+{
+	btVector3 extent = aabbMax - aabbMin;
+	btScalar size = extent[extent.maxAxis()];
+
+	for (level = 0; level < numLevels; ++level)
+	{
+		if (size <= cellSizes[level])
+			break;
+	}
+
+	if (level == numLevels)
+	{
+		level = -1;
+		return false;
+	}
+
+	// bounds outside the representable cells are treated like oversized ones
+	btScalar limit = cellSizes[level] * btScalar(CellCoordLimit);
+	for (int i = 0; i < 3; ++i)
+	{
+		if (aabbMin[i] <= -limit || aabbMax[i] >= limit)
+		{
+			level = -1;
+			return false;
+		}
+	}
+
+	getCellRangeOnLevel(level, aabbMin, aabbMax, cellMin, cellMax);
+	return true;
+}
+
+void HashGridBroadphase::insertIntoCells(HashGridProxy* proxy)
+{
+	if (!getCellRange(proxy->m_aabbMin, proxy->m_aabbMax, proxy->level, proxy->cellMin, proxy->cellMax))
+	{
+		oversizedProxies.push_back(proxy);
+		return;
+	}
+
+	numProxiesPerLevel[proxy->level]++;
+
+	for (int x = proxy->cellMin[0]; x <= proxy->cellMax[0]; ++x)
+		for (int y = proxy->cellMin[1]; y <= proxy->cellMax[1]; ++y)
+			for (int z = proxy->cellMin[2]; z <= proxy->cellMax[2]; ++z)
+				cells[packCellKey(proxy->level, x, y, z)].push_back(proxy);
+}
+
+void HashGridBroadphase::removeFromCells(HashGridProxy* proxy)
+{
+	if (proxy->level < 0)
+	{
+		oversizedProxies.remove(proxy);
+		return;
+	}
+
+	numProxiesPerLevel[proxy->level]--;
+
+	for (int x = proxy->cellMin[0]; x <= proxy->cellMax[0]; ++x)
+	{
+		for (int y = proxy->cellMin[1]; y <= proxy->cellMax[1]; ++y)
+		{
+			for (int z = proxy->cellMin[2]; z <= proxy->cellMax[2]; ++z)
+			{
+				CellMap::iterator it = cells.find(packCellKey(proxy->level, x, y, z));
+				btAssert(it != cells.end());
+
+				std::vector<HashGridProxy*>& cell = it->second;
+				for (size_t i = 0; i < cell.size(); ++i)
+				{
+					if (cell[i] == proxy)
+					{
+						cell[i] = cell.back();
+						cell.pop_back();
+						break;
+					}
+				}
+
+				if (cell.empty())
+					cells.erase(it);
+			}
+		}
+	}
+}
+
+void HashGridBroadphase::markMoved(HashGridProxy* proxy)
+{
+	if (proxy->movedIndex >= 0)
+		return;
+
+	proxy->movedIndex = movedProxies.size();
+	movedProxies.push_back(proxy);
+}
+
+btBroadphaseProxy* HashGridBroadphase::createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher)
+{
+	HashGridProxy* proxy = new HashGridProxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask);
+	proxy->m_uniqueId = ++nextUid;
+
+	proxy->index = proxies.size();
+	proxies.push_back(proxy);
+
+	insertIntoCells(proxy);
+
+	// the new proxy's pairs are found with the next pair update
+	markMoved(proxy);
+
+	return proxy;
+}
+
+void HashGridBroadphase::destroyProxy(btBroadphaseProxy* proxyOrg, btDispatcher* dispatcher)
+{
+	HashGridProxy* proxy = static_cast<HashGridProxy*>(proxyOrg);
+
+	pairCache->removeOverlappingPairsContainingProxy(proxy, dispatcher);
+	removeFromCells(proxy);
+
+	if (proxy->movedIndex >= 0)
+	{
+		HashGridProxy* last = movedProxies[movedProxies.size() - 1];
+		movedProxies[proxy->movedIndex] = last;
+		last->movedIndex = proxy->movedIndex;
+		movedProxies.pop_back();
+	}
+
+	HashGridProxy* last = proxies[proxies.size() - 1];
+	proxies[proxy->index] = last;
+	last->index = proxy->index;
+	proxies.pop_back();
+
+	delete proxy;
+}
+
+void HashGridBroadphase::setAabb(btBroadphaseProxy* proxyOrg, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher)
+{
+	HashGridProxy* proxy = static_cast<HashGridProxy*>(proxyOrg);
+
+	// resting and sleeping bodies report the same bounds every step
+	if (proxy->m_aabbMin == aabbMin && proxy->m_aabbMax == aabbMax)
+		return;
+
+	proxy->m_aabbMin = aabbMin;
+	proxy->m_aabbMax = aabbMax;
+	markMoved(proxy);
+
+	int level;
+	int cellMin[3];
+	int cellMax[3];
+	bool inGrid = getCellRange(aabbMin, aabbMax, level, cellMin, cellMax);
+
+	// most steps a proxy stays within its cells
+	if (inGrid && level == proxy->level
+		&& cellMin[0] == proxy->cellMin[0] && cellMin[1] == proxy->cellMin[1] && cellMin[2] == proxy->cellMin[2]
+		&& cellMax[0] == proxy->cellMax[0] && cellMax[1] == proxy->cellMax[1] && cellMax[2] == proxy->cellMax[2])
+		return;
+
+	if (!inGrid && proxy->level < 0)
+		return;
+
+	removeFromCells(proxy);
+	insertIntoCells(proxy);
+}
+
+void HashGridBroadphase::getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const
+{
+	aabbMin = proxy->m_aabbMin;
+	aabbMax = proxy->m_aabbMax;
+}
+
+void HashGridBroadphase::rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin, const btVector3& aabbMax)
+{
+	for (int i = 0; i < proxies.size(); ++i)
+		rayCallback.process(proxies[i]);
+}
+
+void HashGridBroadphase::aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback)
+{
+	for (int i = 0; i < oversizedProxies.size(); ++i)
+	{
+		if (TestAabbAgainstAabb2(aabbMin, aabbMax, oversizedProxies[i]->m_aabbMin, oversizedProxies[i]->m_aabbMax))
+			callback.process(oversizedProxies[i]);
+	}
+
+	for (int level = 0; level < numLevels; ++level)
+	{
+		if (numProxiesPerLevel[level] == 0)
+			continue;
+
+		int cellMin[3];
+		int cellMax[3];
+		getCellRangeOnLevel(level, aabbMin, aabbMax, cellMin, cellMax);
+
+		// a proxy covering several cells is reported from the cell holding the minimum of the intersection
+		btScalar cellSize = cellSizes[level];
+		forEachCell(cells, level, cellMin, cellMax, [&](const int* cell, const std::vector<HashGridProxy*>& cellProxies)
+		{
+			for (size_t i = 0; i < cellProxies.size(); ++i)
+			{
+				HashGridProxy* proxy = cellProxies[i];
+				if (!TestAabbAgainstAabb2(aabbMin, aabbMax, proxy->m_aabbMin, proxy->m_aabbMax))
+					continue;
+
+				btVector3 overlapMin = aabbMin;
+				overlapMin.setMax(proxy->m_aabbMin);
+				if (getCellCoord(overlapMin[0], cellSize) == cell[0] && getCellCoord(overlapMin[1], cellSize) == cell[1] && getCellCoord(overlapMin[2], cellSize) == cell[2])
+					callback.process(proxy);
+			}
+		});
+	}
+}
+
+void HashGridBroadphase::findPairs(HashGridProxy* proxy, btAlignedObjectArray<ProxyPair>& pairs) const
+{
+	const btVector3& aabbMin = proxy->m_aabbMin;
+	const btVector3& aabbMax = proxy->m_aabbMax;
+
+	// oversized proxies are tested against everything
+	if (proxy->level < 0)
+	{
+		for (int i = 0; i < proxies.size(); ++i)
+		{
+			HashGridProxy* other = proxies[i];
+			if (reportsPairWith(proxy, other) && TestAabbAgainstAabb2(aabbMin, aabbMax, other->m_aabbMin, other->m_aabbMax))
+				pairs.push_back(ProxyPair{ proxy, other });
+		}
+		return;
+	}
+
+	for (int i = 0; i < oversizedProxies.size(); ++i)
+	{
+		HashGridProxy* other = oversizedProxies[i];
+		if (reportsPairWith(proxy, other) && TestAabbAgainstAabb2(aabbMin, aabbMax, other->m_aabbMin, other->m_aabbMax))
+			pairs.push_back(ProxyPair{ proxy, other });
+	}
+
+	for (int level = 0; level < numLevels; ++level)
+	{
+		if (numProxiesPerLevel[level] == 0)
+			continue;
+
+		int cellMin[3];
+		int cellMax[3];
+		if (level == proxy->level)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				cellMin[i] = proxy->cellMin[i];
+				cellMax[i] = proxy->cellMax[i];
+			}
+		}
+		else
+		{
+			getCellRangeOnLevel(level, aabbMin, aabbMax, cellMin, cellMax);
+		}
+
+		// both proxies cover the cell holding the minimum of their intersection, only that cell reports them
+		btScalar cellSize = cellSizes[level];
+		forEachCell(cells, level, cellMin, cellMax, [&](const int* cell, const std::vector<HashGridProxy*>& cellProxies)
+		{
+			for (size_t i = 0; i < cellProxies.size(); ++i)
+			{
+				HashGridProxy* other = cellProxies[i];
+				if (!reportsPairWith(proxy, other) || !TestAabbAgainstAabb2(aabbMin, aabbMax, other->m_aabbMin, other->m_aabbMax))
+					continue;
+
+				btVector3 overlapMin = aabbMin;
+				overlapMin.setMax(other->m_aabbMin);
+				if (getCellCoord(overlapMin[0], cellSize) == cell[0] && getCellCoord(overlapMin[1], cellSize) == cell[1] && getCellCoord(overlapMin[2], cellSize) == cell[2])
+					pairs.push_back(ProxyPair{ proxy, other });
+			}
+		});
+	}
+}
+
+// queries a range of the moved proxies into the pair list of the calling worker
+struct FindPairsLoop : public btIParallelForBody
+{
+	const HashGridBroadphase* broadphase;
+	HashGridProxy* const* movedProxies;
+	btAlignedObjectArray<HashGridBroadphase::ProxyPair>* threadPairs;
+
+	virtual void forLoop(int iBegin, int iEnd) const
+	{
+		btAlignedObjectArray<HashGridBroadphase::ProxyPair>& pairs = threadPairs[btGetCurrentThreadIndex()];
+		for (int i = iBegin; i < iEnd; ++i)
+			broadphase->findPairs(movedProxies[i], pairs);
+	}
+};
+
+void HashGridBroadphase::removeSeparatedPairs(int minChecks, btDispatcher* dispatcher)
+{
+	btBroadphasePairArray& pairs = pairCache->getOverlappingPairArray();
+	int numChecks = btMin(btMin(numPairsToCheck, pairs.size()), btMax(minChecks, pairs.size() * CleanupPercent / 100));
+	numPairsToCheck -= numChecks;
+
+	while (numChecks > 0 && pairs.size() > 0)
+	{
+		if (cleanupCursor >= pairs.size())
+			cleanupCursor = 0;
+
+		btBroadphaseProxy* proxy0 = pairs[cleanupCursor].m_pProxy0;
+		btBroadphaseProxy* proxy1 = pairs[cleanupCursor].m_pProxy1;
+		if (TestAabbAgainstAabb2(proxy0->m_aabbMin, proxy0->m_aabbMax, proxy1->m_aabbMin, proxy1->m_aabbMax))
+		{
+			++cleanupCursor;
+			--numChecks;
+		}
+		else
+		{
+			// the last pair is moved into the removed slot and checked next
+			pairCache->removeOverlappingPair(proxy0, proxy1, dispatcher);
+		}
+	}
+}
+
+void HashGridBroadphase::calculateOverlappingPairs(btDispatcher* dispatcher)
+{
+	if (movedProxies.size() == 0)
+	{
+		if (numPairsToCheck > 0)
+			removeSeparatedPairs(0, dispatcher);
+		return;
+	}
+
+	BT_PROFILE("HashGridBroadphase::calculateOverlappingPairs");
+
+	FindPairsLoop loop;
+	loop.broadphase = this;
+	loop.movedProxies = &movedProxies[0];
+	loop.threadPairs = threadPairs;
+
+	// the grid is not modified while the workers query it. btParallelFor asserts in a Bullet built
+	// without BT_THREADSAFE
+#ifdef BT_THREADSAFE
+	btParallelFor(0, movedProxies.size(), 64, loop);
+#else
+	loop.forLoop(0, movedProxies.size());
+#endif
+
+	// the pair cache is not thread safe, the found pairs are added here
+	int numFoundPairs = 0;
+	for (unsigned int t = 0; t < BT_MAX_THREAD_COUNT; ++t)
+	{
+		btAlignedObjectArray<ProxyPair>& pairs = threadPairs[t];
+		for (int i = 0; i < pairs.size(); ++i)
+			pairCache->addOverlappingPair(pairs[i].proxy0, pairs[i].proxy1);
+		numFoundPairs += pairs.size();
+		pairs.resizeNoInitialize(0);
+	}
+
+	// any cached pair may have separated now, they are swept a slice per step from here on
+	numPairsToCheck = pairCache->getOverlappingPairArray().size();
+	removeSeparatedPairs(numFoundPairs, dispatcher);
+
+	for (int i = 0; i < movedProxies.size(); ++i)
+		movedProxies[i]->movedIndex = -1;
+	movedProxies.resizeNoInitialize(0);
+}
+
+void HashGridBroadphase::getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const
+{
+	aabbMin.setValue(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+	aabbMax.setValue(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+}
+
+void HashGridBroadphase::resetPool(btDispatcher* dispatcher)
+{
+	// empty cells are erased as proxies leave them, only the hash buckets remain
+	if (proxies.size() == 0)
+	{
+		CellMap().swap(cells);
+		oversizedProxies.clear();
+		movedProxies.clear();
+		nextUid = 0;
+		cleanupCursor = 0;
+		numPairsToCheck = 0;
+	}
+}
+
+void HashGridBroadphase::printStats()
+{
+	printf("HashGridBroadphase: %d proxies, %d oversized, %d occupied cells\n", proxies.size(), oversizedProxies.size(), static_cast<int>(cells.size()));
+	for (int i = 0; i < numLevels; ++i)
+		printf("  level %d: cell size %.2f, %d proxies\n", i, cellSizes[i], numProxiesPerLevel[i]);
+}
@@ -0,0 +1,137 @@
+#ifndef HASHGRIDBROADPHASE_H
+#define HASHGRIDBROADPHASE_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "btBulletDynamicsCommon.h"
+
+// a proxy lives in the cells of the finest level whose cells are at least as large as its bounds,
+// so it covers at most 2x2x2 cells. proxies too large for the coarsest level (the ground plane) are
+// kept in a list that every moving proxy is tested against
+struct HashGridProxy : public btBroadphaseProxy
+{
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+
+	HashGridProxy(const btVector3& aabbMin, const btVector3& aabbMax, void* userPtr, int collisionFilterGroup, int collisionFilterMask)
+		: btBroadphaseProxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask), level(-1), index(-1), movedIndex(-1)
+	{
+		cellMin[0] = cellMin[1] = cellMin[2] = 0;
+		cellMax[0] = cellMax[1] = cellMax[2] = -1;
+	}
+
+	// -1 for oversized proxies
+	int level;
+	int cellMin[3];
+	int cellMax[3];
+
+	// slot in the broadphase's proxy array and in its list of proxies moved since the last pair update
+	int index;
+	int movedIndex;
+};
+
+// uniform grid broadphase with one spatial hash per level, level n has cells of cellSize * 2^n. suited to
+// scenes of many bodies of about the same size, which all end up on one level.
+// setAabb only touches the hash when a proxy crosses a cell boundary and ignores proxies whose bounds did
+// not change, so sleeping bodies cost nothing. calculateOverlappingPairs queries the grid for the moved
+// proxies with btParallelFor and only then adds the pairs to the cache, on the calling thread. pairs that
+// separated are removed a slice per step like btDbvtBroadphase does, the narrowphase finds no contacts for
+// them in the meantime
+class HashGridBroadphase : public btBroadphaseInterface
+{
+public:
+	// cellSize should be about the largest extent of the scene's typical body
+	explicit HashGridBroadphase(btScalar cellSize, int numLevels = 4, btOverlappingPairCache* pairCache = nullptr);
+	virtual ~HashGridBroadphase();
+
+	enum
+	{
+		MaxLevels = 8,
+		// share of the cached pairs tested for separation per step, as btDbvtBroadphase does
+		CleanupPercent = 10
+	};
+
+	int getNumProxies() const
+	{
+		return proxies.size();
+	}
+
+	int getNumCells() const
+	{
+		return static_cast<int>(cells.size());
+	}
+
+	virtual btBroadphaseProxy* createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher);
+	virtual void destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher);
+	virtual void setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher);
+	virtual void getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const;
+
+	// rays visit every proxy, like btSimpleBroadphase
+	virtual void rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin = btVector3(0, 0, 0), const btVector3& aabbMax = btVector3(0, 0, 0));
+	virtual void aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback);
+
+	virtual void calculateOverlappingPairs(btDispatcher* dispatcher);
+
+	virtual btOverlappingPairCache* getOverlappingPairCache()
+	{
+		return pairCache;
+	}
+
+	virtual const btOverlappingPairCache* getOverlappingPairCache() const
+	{
+		return pairCache;
+	}
+
+	virtual void getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const;
+	virtual void resetPool(btDispatcher* dispatcher);
+	virtual void printStats();
+
+	struct ProxyPair
+	{
+		HashGridProxy* proxy0;
+		HashGridProxy* proxy1;
+	};
+
+	typedef std::unordered_map<unsigned long long, std::vector<HashGridProxy*> > CellMap;
+
+	// the grid is only read while the moved proxies are queried in parallel
+	void findPairs(HashGridProxy* proxy, btAlignedObjectArray<ProxyPair>& pairs) const;
+
+private:
+	btOverlappingPairCache* pairCache;
+	bool ownsPairCache;
+
+	btScalar cellSizes[MaxLevels];
+	int numLevels;
+	int numProxiesPerLevel[MaxLevels];
+
+	CellMap cells;
+
+	btAlignedObjectArray<HashGridProxy*> proxies;
+	btAlignedObjectArray<HashGridProxy*> oversizedProxies;
+	btAlignedObjectArray<HashGridProxy*> movedProxies;
+
+	// one pair list per worker thread, merged into the pair cache after the parallel query
+	btAlignedObjectArray<ProxyPair> threadPairs[BT_MAX_THREAD_COUNT];
+
+	int nextUid;
+
+	// separated pairs are removed incrementally, the sweep continues at the cursor while pairs are left
+	// to check since the last move
+	int cleanupCursor;
+	int numPairsToCheck;
+
+	// pick the level for the bounds and compute the covered cell range, false if the proxy is oversized
+	bool getCellRange(const btVector3& aabbMin, const btVector3& aabbMax, int& level, int* cellMin, int* cellMax) const;
+	void getCellRangeOnLevel(int level, const btVector3& aabbMin, const btVector3& aabbMax, int* cellMin, int* cellMax) const;
+
+	void insertIntoCells(HashGridProxy* proxy);
+	void removeFromCells(HashGridProxy* proxy);
+	void markMoved(HashGridProxy* proxy);
+	void removeSeparatedPairs(int minChecks, btDispatcher* dispatcher);
+
+	HashGridBroadphase(const HashGridBroadphase& that);
+	HashGridBroadphase& operator=(const HashGridBroadphase& that);
+};
+
+#endif
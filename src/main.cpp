@@ -3,6 +3,10 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -15,155 +19,58 @@ using namespace glm;
 #include "imagedata.h"
 #include "glshader.h"
 #include "glmeshdata.h"
+#include "glstats.h"
+#include "gldebug.h"
+#include "glstatecache.h"
+#include "glcamerabuffer.h"
+#include "glringbuffer.h"
+#include "glsphereimpostors.h"
+#include "glrenderqueue.h"
+#include "renderbuckets.h"
+#include "physicsthread.h"
+#include "projectilemanager.h"
+#include "frustum.h"
 
 // bt
 #include "btBulletDynamicsCommon.h"
+#include "physicsscene.h"
 #include <stdio.h>
 
-btDefaultCollisionConfiguration* collisionConfiguration;
-btCollisionDispatcher* dispatcher;
-btBroadphaseInterface* overlappingPairCache;
-btSequentialImpulseConstraintSolver* solver;
-btDiscreteDynamicsWorld* dynamicsWorld;
+// render meshes bucketed by collision shape, bodies are registered once at creation
+RenderBuckets g_render_buckets;
 
-// collision shape array, release memory at exit
-btAlignedObjectArray<btCollisionShape*> collisionShapes;
+const float g_body_albedo[3][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+int g_num_registered_bodies = 0;
 
-void initPhysics();
-void stepPhysics();
-void cleanupPhysics();
-
-void initPhysics()
+void registerBody(btRigidBody* body)
 {
-	// collision configuration contains default setup for memory, collision setup
-	collisionConfiguration = new btDefaultCollisionConfiguration();
-
-	// default collision dispatcher
-	dispatcher = new btCollisionDispatcher(collisionConfiguration);
-
-	// general purpose broadphase
-	overlappingPairCache = new btDbvtBroadphase();
-
-	// default constraint solver
-	solver = new btSequentialImpulseConstraintSolver;
-
-	dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, overlappingPairCache, solver, collisionConfiguration);
-
-	dynamicsWorld->setGravity(btVector3(0, -10, 0));
-
-	// create a few basic rigid bodies
-
-	// ground plane
-	{
-		btCollisionShape* groundShape = new btStaticPlaneShape(btVector3(btScalar(0), btScalar(1), btScalar(0)), btScalar(0));
-
-		collisionShapes.push_back(groundShape);
-
-		btTransform groundTransform;
-		groundTransform.setIdentity();
-		groundTransform.setOrigin(btVector3(0, 0, 0));
-
-		btScalar mass(0.f);
-
-		// rigidbody is dynamic if and only if mass is non zero, otherwise static
-		bool isDynamic = (mass != 0.f);
-
-		btVector3 localInertia(0, 0, 0);
-		if (isDynamic)
-			groundShape->calculateLocalInertia(mass, localInertia);
-
-		// using motionstate is optional, it provides interpolation capabilities, and only synchronizes 'active' objects
-		btDefaultMotionState* myMotionState = new btDefaultMotionState(groundTransform);
-		btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, myMotionState, groundShape, localInertia);
-		btRigidBody* body = new btRigidBody(rbInfo);
-
-		// add the body to the dynamics world
-		dynamicsWorld->addRigidBody(body);
-	}
-	
-	{
-		btCollisionShape* colShape;
-		btTransform startTransform;
-		btScalar mass(0.25f);
-		float rad = 12.0f;
-
-		for (int j = 0; j < 24; j++)
-		{
-			for (int i = 0; i < 16; i++)
-			{
-				colShape = new btBoxShape(btVector3(btScalar(1.125), btScalar(1.0), btScalar(2.0)));
-				collisionShapes.push_back(colShape);
-
-				startTransform.setIdentity();
-
-				// rigidbody is dynamic if and only if mass is non zero, otherwise static
-				bool isDynamic = (mass != 0.f);
-
-				btVector3 localInertia(0, 0, 0);
-				if (isDynamic)
-					colShape->calculateLocalInertia(mass, localInertia);
-
-				startTransform.setOrigin(btVector3(rad * cos(2.0f * static_cast<float>(M_PI) * (i + static_cast<float>(j % 2) / 2.0f) / 16.0f), 1.0f + j * 2.0f, -rad * sin(2.0f * static_cast<float>(M_PI) * (i + static_cast<float>(j % 2) / 2.0f) / 16.0f)));
-				startTransform.setRotation(btQuaternion(btVector3(btScalar(0), btScalar(1), btScalar(0)), btScalar((i + static_cast<float>(j % 2) / 2.0f) * 2.0f * static_cast<float>(M_PI) / 16.0f)));
-
-				// using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
-				btDefaultMotionState* myMotionState = new btDefaultMotionState(startTransform);
-				btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, myMotionState, colShape, localInertia);
-				btRigidBody* body = new btRigidBody(rbInfo);
-
-				dynamicsWorld->addRigidBody(body);
-			}
-		}
-	}
+	g_render_buckets.addBody(body, g_body_albedo[g_num_registered_bodies++ % 3]);
 }
 
-void cleanupPhysics()
+void unregisterBody(btRigidBody* body)
 {
-	// cleanup in the reverse order of creation/initialization
-
-	// remove the rigidbodies from the dynamics world and delete them
-	for (int i = dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--)
-	{
-		btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
-		btRigidBody* body = btRigidBody::upcast(obj);
-		if (body && body->getMotionState())
-		{
-			delete body->getMotionState();
-		}
-		dynamicsWorld->removeCollisionObject(obj);
-		delete obj;
-	}
-
-	// delete collision shapes
-	for (int j = 0; j < collisionShapes.size(); j++)
-	{
-		btCollisionShape* shape = collisionShapes[j];
-		collisionShapes[j] = 0;
-		delete shape;
-	}
-
-	// delete dynamics world
-	delete dynamicsWorld;
+	g_render_buckets.removeBody(body);
+}
 
-	// delete solver
-	delete solver;
+// bodies outside the view frustum are not submitted, disabled with --no-culling
+bool g_frustum_culling = true;
 
-	// delete broadphase
-	delete overlappingPairCache;
+// instances pick a mesh level of detail from their projected size, disabled with --no-lod
+bool g_mesh_lod = true;
 
-	// delete dispatcher
-	delete dispatcher;
+// spheres farther than this are drawn as ray traced impostors, 0 disables them (--impostor-distance)
+float g_impostor_distance = 100.0f;
 
-	delete collisionConfiguration;
+// lay down depth before shading, for fill bound scenes
+bool g_depth_prepass = false;
 
-	// next line is optional: it will be cleared by the destructor when the array goes out of scope
-	collisionShapes.clear();
-}
+// fired spheres, retired by cap, age and bounds and recycled on the next shot
+ProjectileManager* g_projectiles = nullptr;
+ProjectileConfig g_projectile_config;
 
-void stepPhysics()
-{
-	dynamicsWorld->stepSimulation(1.f / 60.f, 10);
-}
+// optional fixed rate physics thread, enabled with --physics-thread [hz]
+PhysicsThread* g_physics_thread = nullptr;
+double g_physics_thread_hz = 120.0;
 
 GLFWwindow* window;
 std::string g_app_title = "minimal_glfw_bullet";
@@ -302,34 +209,35 @@ void fireSphere(btVector3 pos, btVector3 dir, float speed)
 {
 	// sphere
 	{
-		// create a dynamic rigidbody
-		btCollisionShape* colShape = new btSphereShape(btScalar(1.));
-		collisionShapes.push_back(colShape);
+		// the physics thread must not step while the world is modified
+		std::unique_lock<std::mutex> lock;
+		if (g_physics_thread)
+			lock = g_physics_thread->lockWorld();
 
-		// create dynamic objects
-		btTransform startTransform;
-		startTransform.setIdentity();
+		// every projectile shares one sphere shape, retired bodies are reused
+		btCollisionShape* colShape = getSphereShape(btScalar(1.));
 
 		btScalar mass(1.f);
 
-		// rigidbody is dynamic if and only if mass is non zero, otherwise static
-		bool isDynamic = (mass != 0.f);
-
-		btVector3 localInertia(0, 0, 0);
-		if (isDynamic)
-			colShape->calculateLocalInertia(mass, localInertia);
+		g_projectiles->spawn(colShape, mass, pos, dir * speed);
+	}
+}
 
-		startTransform.setOrigin(pos);
+// throw away every body and build the initial scene again
+void resetScene()
+{
+	std::unique_lock<std::mutex> lock;
+	if (g_physics_thread)
+		lock = g_physics_thread->lockWorld();
 
-		// using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
-		btDefaultMotionState* myMotionState = new btDefaultMotionState(startTransform);
-		btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, myMotionState, colShape, localInertia);
-		btRigidBody* body = new btRigidBody(rbInfo);
+	// the world clears all bodies at once, nobody may keep a reference to them
+	g_render_buckets.clearBodies();
+	g_projectiles->clear();
 
-		body->setLinearVelocity(dir * speed);
+	resetPhysicsScene();
 
-		dynamicsWorld->addRigidBody(body);
-	}
+	if (g_physics_thread)
+		g_physics_thread->discardHistory();
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -337,6 +245,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 
+	if (key == GLFW_KEY_R && action == GLFW_PRESS)
+		resetScene();
+
 	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
 	{
 		glm::vec3 direction(
@@ -365,8 +276,60 @@ static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	g_height = height;
 }
 
-int main(void)
+int main(int argc, char* argv[])
 {
+	PhysicsSceneConfig sceneConfig;
+	bool usePhysicsThread = false;
+	bool headless = false;
+	int headlessFrames = 600;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				headlessFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--physics-thread") == 0)
+		{
+			usePhysicsThread = true;
+			if (i + 1 < argc && atof(argv[i + 1]) > 0.0)
+				g_physics_thread_hz = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--no-culling") == 0)
+		{
+			g_frustum_culling = false;
+		}
+		else if (strcmp(argv[i], "--no-lod") == 0)
+		{
+			g_mesh_lod = false;
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			g_depth_prepass = true;
+		}
+		else if (strcmp(argv[i], "--impostor-distance") == 0 && i + 1 < argc)
+		{
+			g_impostor_distance = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--static-batch-frames") == 0 && i + 1 < argc)
+		{
+			g_render_buckets.setStaticBatchFrames(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--max-projectiles") == 0 && i + 1 < argc)
+		{
+			g_projectile_config.maxProjectiles = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--projectile-ttl") == 0 && i + 1 < argc)
+		{
+			g_projectile_config.timeToLive = static_cast<float>(atof(argv[++i]));
+		}
+		else
+		{
+			parsePhysicsSceneArg(argc, argv, i, sceneConfig);
+		}
+	}
+
 	{
 		std::string locStr = "resources.loc";
 		size_t len = locStr.size();
@@ -375,7 +338,11 @@ int main(void)
 		rootData = locStr.substr(0, locStr.size() - len);
 	}
 
-	initPhysics();
+	setBodyCreatedCallback(registerBody);
+	initPhysics(sceneConfig);
+
+	g_projectiles = new ProjectileManager(dynamicsWorld, g_projectile_config);
+	g_projectiles->setCallbacks(registerBody, unregisterBody);
 
 	// initialise GLFW
 	if (!glfwInit())
@@ -384,11 +351,23 @@ int main(void)
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_SAMPLES, 4);
+	if (headless)
+	{
+		// offscreen software context, build with HEADLESS_OSMESA for machines without a display
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
+	else
+	{
+		glfwWindowHint(GLFW_SAMPLES, 4);
+	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef NDEBUG
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 
 	// open a window and create its OpenGL context
 	window = glfwCreateWindow(g_width, g_height, g_app_title.c_str(), NULL, NULL);
@@ -398,7 +377,7 @@ int main(void)
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
+	glfwSwapInterval(headless ? 0 : 1);
 
 	// set glfw callbacks
 	glfwSetKeyCallback(window, key_callback);
@@ -412,6 +391,10 @@ int main(void)
 		return -1;
 	}
 
+	// glewInit may leave GL_INVALID_ENUM behind on core profiles
+	glGetError();
+	initGLDebugOutput();
+
 	// output some info on the OpenGL implementation
 	const GLubyte* glvendor = glGetString(GL_VENDOR);
 	const GLubyte* glrenderer = glGetString(GL_RENDERER);
@@ -437,12 +420,6 @@ int main(void)
 	GLMeshData myPlane;
 	myPlane.createPlane(0.0f, 128.0f, 2.0f);
 
-	GLMeshData myBox;
-	myBox.createBox(2.25f, 2.0f, 4.0f);
-
-	GLMeshData mySphere;
-	mySphere.createSphere(1.0f, 32, 32);
-
 	{
 		ImageData image;
 		image.loadBMP(rootData + "textures/crate.bmp");
@@ -514,122 +491,261 @@ int main(void)
 	// create and compile our GLSL program from the shaders
 	GLuint programID = LoadShaders((rootData + "shaders/TransformVertexShader.vertexshader").c_str(), (rootData + "shaders/TextureFragmentShader.fragmentshader").c_str());
 
-	// get a handle for our "MVP" uniform
-	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
+	// get a handle for our "M" uniform
+	GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
 
-	// get a handle for our "myTextureSampler" uniform
+	// get a handle for our "albedo" uniform
 	GLuint ColorID = glGetUniformLocation(programID, "albedo");
 
-	glm::vec3 albedo  = glm::vec3(0.5f, 0.5f, 0.5f);
-	glm::vec3 albedoR = glm::vec3(1.0f, 0.0f, 0.0f);
-	glm::vec3 albedoG = glm::vec3(0.0f, 1.0f, 0.0f);
-	glm::vec3 albedoB = glm::vec3(0.0f, 0.0f, 1.0f);
+	// instanced program for the rigid bodies, model matrix and albedo are per-instance attributes
+	GLuint instancedProgramID = LoadShaders((rootData + "shaders/InstancedVertexShader.vertexshader").c_str(), (rootData + "shaders/InstancedFragmentShader.fragmentshader").c_str());
 
-	glm::vec3 albedoArray[] = { albedoR, albedoG, albedoB };
+	// view-projection lives in the camera uniform buffer, written once per frame and shared by both programs
+	GLCameraBuffer cameraBuffer;
+	cameraBuffer.create();
+	GLCameraBuffer::bindProgram(programID);
+	GLCameraBuffer::bindProgram(instancedProgramID);
 
-	double lastFPStime = glfwGetTime();
-	int frameCounter = 0;
+	// far spheres are a quad each, ray traced in the fragment shader
+	GLuint impostorProgramID = LoadShaders((rootData + "shaders/ImpostorVertexShader.vertexshader").c_str(), (rootData + "shaders/ImpostorFragmentShader.fragmentshader").c_str());
+	GLCameraBuffer::bindProgram(impostorProgramID);
 
-	do {
-		double thisFPStime = glfwGetTime();
-		frameCounter++;
+	GLSphereImpostors sphereImpostors;
+	sphereImpostors.create();
+	g_render_buckets.setImpostors(g_impostor_distance > 0.0f ? &sphereImpostors : nullptr, impostorProgramID, g_impostor_distance);
 
-		if (thisFPStime - lastFPStime >= 1.0)
-		{
-			lastFPStime = thisFPStime;
+	// every opaque draw of the frame goes through the queue
+	GLRenderQueue renderQueue;
+	renderQueue.setDepthPrepass(g_depth_prepass);
+	g_render_buckets.setRenderQueue(&renderQueue, instancedProgramID);
 
-			std::string windowTitle = g_app_title + " (";
-			windowTitle += std::to_string(frameCounter);
-			windowTitle += " fps)";
-			const char* windowCaption = windowTitle.c_str();
-			glfwSetWindowTitle(window, windowCaption);
+	// per-frame instance data of all buckets, one segment per frame in flight
+	GLRingBuffer instanceStream;
+	instanceStream.create(GL_ARRAY_BUFFER, 4 * 1024 * 1024);
+	g_render_buckets.setStreamBuffer(&instanceStream);
+	printf("instance stream: %s\n", instanceStream.isPersistent() ? "persistent mapping" : "unsynchronized mapping");
 
-			frameCounter = 0;
-		}
+	glm::vec3 albedo  = glm::vec3(0.5f, 0.5f, 0.5f);
 
-		stepPhysics();
+	if (usePhysicsThread && !headless)
+	{
+		printf("physics thread: %.1f Hz\n", g_physics_thread_hz);
+
+		g_physics_thread = new PhysicsThread(dynamicsWorld, 1.0 / g_physics_thread_hz);
+		g_physics_thread->start();
+	}
+
+	// draw the bodies from the snapshot (or the motion states without one) and the ground plane
+	auto renderScene = [&](const PhysicsSnapshot* snapshot, float alpha)
+	{
+		instanceStream.beginFrame();
 
 		glViewport(0, 0, g_width, g_height);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// bind shader
-		glUseProgram(programID);
+		// view-projection, the only matrix product of the frame
+		glm::mat4 vp_mat = g_proj_matrix * g_view_matrix;
+		glm::vec4 eye = glm::inverse(g_view_matrix)[3];
+		{
+			GLCameraData camera;
+			memcpy(camera.viewProj, glm::value_ptr(vp_mat), sizeof(camera.viewProj));
+			memcpy(camera.view, glm::value_ptr(g_view_matrix), sizeof(camera.view));
+			memcpy(camera.proj, glm::value_ptr(g_proj_matrix), sizeof(camera.proj));
+
+			memcpy(camera.eye, glm::value_ptr(eye), sizeof(camera.eye));
 
-		// compute the MVP matrix from keyboard and mouse input
-		computeMatricesFromInputs();
+			cameraBuffer.update(camera);
+
+			// pixels covered by a unit radius at distance one
+			float pixelsPerUnit = g_mesh_lod ? 0.5f * float(g_height) * g_proj_matrix[1][1] : 0.0f;
+			g_render_buckets.setLodView(btVector3(eye.x, eye.y, eye.z), pixelsPerUnit);
+		}
 
-		// render collsion shapes
+		// collision shapes, one instanced draw per render bucket and level of detail, queued
 		{
-			for (int j = dynamicsWorld->getNumCollisionObjects() - 1; j >= 0; j--)
-			{
-				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[j];
-				btRigidBody* body = btRigidBody::upcast(obj);
-				btTransform transform;
-				if (body && body->getMotionState())
-				{
-					body->getMotionState()->getWorldTransform(transform);
-				}
-				else
-				{
-					transform = obj->getWorldTransform();
-				}
-
-				// convert the btTransform into the GLM matrix using 'glm::value_ptr'
-				glm::mat4 model_matrix;
-				transform.getOpenGLMatrix(glm::value_ptr(model_matrix));
-
-				// model-view-projection
-				glm::mat4 mvp_mat = g_proj_matrix * g_view_matrix * model_matrix;
-
-				if (strcmp((obj->getCollisionShape())->getName(), "Box") == 0)
-				{
-					glUniform3fv(ColorID, 1, glm::value_ptr(albedoArray[j % 3]));
-
-					glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(mvp_mat));
-					myBox.render();
-				}
-				else if (strcmp((obj->getCollisionShape())->getName(), "SPHERE") == 0)
-				{
-					glUniform3fv(ColorID, 1, glm::value_ptr(albedoArray[j % 3]));
-
-					glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(mvp_mat));
-					mySphere.render();
-				}
-			}
+			Frustum frustum;
+			frustum.extract(glm::value_ptr(vp_mat));
+
+			if (g_frustum_culling)
+				g_render_buckets.render(snapshot, alpha, &frustum, dynamicsWorld->getBroadphase());
+			else
+				g_render_buckets.render(snapshot, alpha);
 		}
 
-		// render ground plane
+		// ground plane, its closest point is straight below the eye
+		glm::mat4 model_matrix = glm::mat4(1.0);
 		{
-			glm::mat4 model_matrix = glm::mat4(1.0);
-			glm::mat4 mvp_mat = g_proj_matrix * g_view_matrix * model_matrix;
+			GLDrawItem item = GLRenderQueue::makeItem(programID);
+			item.mesh = &myPlane;
+			item.modelLocation = ModelMatrixID;
+			item.model = glm::value_ptr(model_matrix);
+			item.colorLocation = ColorID;
+			item.color = glm::value_ptr(albedo);
+
+			renderQueue.submit(item, std::fabs(eye.y));
+		}
+
+		// sorted by state and front to back, after a depth prepass with --depth-prepass
+		renderQueue.flush();
+
+		instanceStream.endFrame();
+	};
+
+	if (headless)
+	{
+		GLMeshData::setOptimizationReport(true);
+		renderQueue.setOverdrawQuery(true);
 
-			glUniform3fv(ColorID, 1, glm::value_ptr(albedo));
+		// record the simulation first so the measured frames contain submission work only
+		printf("headless: recording %d steps\n", headlessFrames);
 
-			glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(mvp_mat));
-			myPlane.render();
+		std::vector<PhysicsSnapshot> recording(headlessFrames);
+		std::vector<PhysicsSnapshot::Entry> noPreviousStep;
+		for (int f = 0; f < headlessFrames; ++f)
+		{
+			stepPhysics();
+			recording[f].capture(dynamicsWorld, noPreviousStep);
+		}
+
+		std::vector<double> submitTimes(headlessFrames);
+		unsigned long long drawCalls = 0, uniformUploads = 0, bufferUploads = 0, instancesDrawn = 0, primitivesDrawn = 0, skippedStateChanges = 0, samplesPassed = 0;
+
+		for (int f = 0; f < headlessFrames; ++f)
+		{
+			// fixed camera path, one orbit around the tower over the recording
+			float angle = 2.0f * float(M_PI) * f / headlessFrames;
+			glm::vec3 eye(70.0f * std::cos(angle), 30.0f, 70.0f * std::sin(angle));
+
+			g_proj_matrix = glm::perspective(g_cam_fov, float(g_width) / float(g_height), 0.25f, 4000.0f);
+			g_view_matrix = glm::lookAt(eye, glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+			g_gl_stats.reset();
+
+			double t0 = glfwGetTime();
+			renderScene(&recording[f], 1.0f);
+			double t1 = glfwGetTime();
+
+			// keep the software rasterizer's work out of the next frame's submission time
+			glFinish();
+
+			submitTimes[f] = (t1 - t0) * 1000.0;
+			drawCalls += g_gl_stats.drawCalls;
+			uniformUploads += g_gl_stats.uniformUploads;
+			bufferUploads += g_gl_stats.bufferUploads;
+			instancesDrawn += g_gl_stats.instancesDrawn;
+			primitivesDrawn += g_gl_stats.primitivesDrawn;
+			skippedStateChanges += g_gl_stats.skippedStateChanges;
+			samplesPassed += renderQueue.readSamplesPassed();
 		}
 
-		// swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		double sum = 0.0;
+		for (int f = 0; f < headlessFrames; ++f)
+			sum += submitTimes[f];
+
+		std::sort(submitTimes.begin(), submitTimes.end());
+
+		printf("frames: %d, bodies: %d\n", headlessFrames, dynamicsWorld->getNumCollisionObjects());
+		printf("cpu submission: mean %.3f ms  p50 %.3f ms  p99 %.3f ms\n", sum / headlessFrames, submitTimes[headlessFrames / 2], submitTimes[(headlessFrames * 99) / 100]);
+		printf("per frame: %.1f draw calls, %.1f uniform uploads, %.1f buffer uploads\n", double(drawCalls) / headlessFrames, double(uniformUploads) / headlessFrames, double(bufferUploads) / headlessFrames);
+		printf("per frame: %.1f redundant state changes skipped\n", double(skippedStateChanges) / headlessFrames);
+		printf("per frame: %.1f of %d bodies drawn (frustum culling %s)\n", double(instancesDrawn) / headlessFrames, dynamicsWorld->getNumCollisionObjects() - 1, g_frustum_culling ? "on" : "off");
+		printf("per frame: %.0f triangles (mesh lod %s)\n", double(primitivesDrawn) / headlessFrames, g_mesh_lod ? "on" : "off");
+		printf("per frame: %.2f shaded samples per pixel (depth prepass %s)\n", double(samplesPassed) / (double(headlessFrames) * g_width * g_height), g_depth_prepass ? "on" : "off");
+		printf("last frame: %d bodies drawn from static batches\n", g_render_buckets.getNumStatic());
+	}
+	else
+	{
+		double lastFPStime = glfwGetTime();
+		double lastFrameTime = lastFPStime;
+		int frameCounter = 0;
 
-	} while (glfwWindowShouldClose(window) == 0);
+		do {
+			double thisFPStime = glfwGetTime();
+			frameCounter++;
+
+			if (thisFPStime - lastFPStime >= 1.0)
+			{
+				lastFPStime = thisFPStime;
+
+				std::string windowTitle = g_app_title + " (";
+				windowTitle += std::to_string(frameCounter);
+				windowTitle += " fps)";
+				const char* windowCaption = windowTitle.c_str();
+				glfwSetWindowTitle(window, windowCaption);
+
+				frameCounter = 0;
+			}
+
+			if (!g_physics_thread)
+				stepPhysics();
+
+			// retire expired projectiles, the physics thread must not step meanwhile
+			{
+				std::unique_lock<std::mutex> lock;
+				if (g_physics_thread)
+					lock = g_physics_thread->lockWorld();
+
+				g_projectiles->update(btScalar(thisFPStime - lastFrameTime));
+				lastFrameTime = thisFPStime;
+			}
+
+			// compute the MVP matrix from keyboard and mouse input
+			computeMatricesFromInputs();
+
+			if (g_physics_thread)
+			{
+				// interpolate between the last two published fixed steps
+				const PhysicsSnapshot& snapshot = g_physics_thread->acquireSnapshot();
+				renderScene(&snapshot, g_physics_thread->getInterpolationAlpha(snapshot));
+			}
+			else
+			{
+				renderScene(nullptr, 1.0f);
+			}
+
+			// swap buffers
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+
+		} while (glfwWindowShouldClose(window) == 0);
+	}
+
+	if (g_physics_thread)
+	{
+		g_physics_thread->stop();
+		delete g_physics_thread;
+		g_physics_thread = nullptr;
+	}
 
 	// cleanup mesh, shader and texture ogl resources
 	myPlane.clear();
-	myBox.clear();
-	mySphere.clear();
+	g_render_buckets.setStreamBuffer(nullptr);
+	g_render_buckets.clear();
+	g_render_buckets.setImpostors(nullptr, 0, 0.0f);
+	g_render_buckets.setRenderQueue(nullptr, 0);
+	renderQueue.clear();
+	sphereImpostors.clear();
+	instanceStream.clear();
+	cameraBuffer.clear();
 
-	glDeleteProgram(programID);
+	g_gl_state.deleteProgram(programID);
+	g_gl_state.deleteProgram(instancedProgramID);
+	g_gl_state.deleteProgram(impostorProgramID);
 
-	glDeleteTextures(1, &texture_crate);
-	glDeleteTextures(1, &texture_checker);
-	glDeleteTextures(num_ball_textures, texIds);
+	g_gl_state.deleteTextures(1, &texture_crate);
+	g_gl_state.deleteTextures(1, &texture_checker);
+	g_gl_state.deleteTextures(num_ball_textures, texIds);
+
+	printGLDebugReport();
 
 	// close ogl window and terminate glfw
 	glfwDestroyWindow(window);
 	// finalize and clean up glfw
 	glfwTerminate();
 
+	// retired projectiles are not in the world anymore, release them before the pools
+	delete g_projectiles;
+	g_projectiles = nullptr;
+
 	cleanupPhysics();
 }
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -14,6 +15,8 @@ using namespace glm;
 #include "imagedata.h"
 #include "glshader.h"
 #include "glmeshdata.h"
+#include "glstatecache.h"
+#include "glcamerabuffer.h"
 
 #define PVD_HOST "127.0.0.1"	//Set this to the IP address of the system running the PhysX Visual Debugger that you want to connect to.
 #define PX_RELEASE(x)	if(x)	{ x->release(); x = NULL; }
@@ -438,8 +441,13 @@ int main(void)
 	// Create and compile our GLSL program from the shaders
 	GLuint programID = LoadShaders((rootData + "shaders/TransformVertexShader.vertexshader").c_str(), (rootData + "shaders/TextureFragmentShader.fragmentshader").c_str());
 
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
+	// Get a handle for our "M" uniform
+	GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
+
+	// view-projection lives in the camera uniform buffer, written once per frame
+	GLCameraBuffer cameraBuffer;
+	cameraBuffer.create();
+	GLCameraBuffer::bindProgram(programID);
 
 	// Get a handle for our "myTextureSampler" uniform
 	GLuint TextureID = glGetUniformLocation(programID, "myTextureSampler");
@@ -470,11 +478,26 @@ int main(void)
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// bind shader
-		glUseProgram(programID);
+		g_gl_state.useProgram(programID);
 
 		// compute the MVP matrix from keyboard and mouse input
 		computeMatricesFromInputs();
 
+		// view-projection, the only matrix product of the frame
+		{
+			glm::mat4 vp_mat = g_proj_matrix * g_view_matrix;
+
+			GLCameraData camera;
+			memcpy(camera.viewProj, glm::value_ptr(vp_mat), sizeof(camera.viewProj));
+			memcpy(camera.view, glm::value_ptr(g_view_matrix), sizeof(camera.view));
+			memcpy(camera.proj, glm::value_ptr(g_proj_matrix), sizeof(camera.proj));
+
+			glm::vec4 eye = glm::inverse(g_view_matrix)[3];
+			memcpy(camera.eye, glm::value_ptr(eye), sizeof(camera.eye));
+
+			cameraBuffer.update(camera);
+		}
+
 		// render physx shapes
 		{
 			const int MAX_NUM_ACTOR_SHAPES = 128;
@@ -491,26 +514,23 @@ int main(void)
 					const PxMat44 shapePose(PxShapeExt::getGlobalPose(*shapes[j], *physx_actors[i].actorPtr));
 					const PxGeometryHolder h = shapes[j]->getGeometry();
 			
-					// render object
-					glm::mat4 model_matrix = glm::make_mat4(&shapePose.column0.x);
-					glm::mat4 mvp_mat = g_proj_matrix * g_view_matrix * model_matrix;
+					// render object, the pose is uploaded as is
+					const GLfloat* model_matrix = &shapePose.column0.x;
 			
 					if (h.getType() == PxGeometryType::eBOX)
 					{
-						glActiveTexture(GL_TEXTURE0);
-						glBindTexture(GL_TEXTURE_2D, texture_crate);
-						glUniform1i(TextureID, 0);
+						g_gl_state.bindTexture(0, GL_TEXTURE_2D, texture_crate);
+						g_gl_state.uniform1i(TextureID, 0);
 			
-						glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(mvp_mat));
+						g_gl_state.uniformMatrix4fv(ModelMatrixID, model_matrix);
 						myBox.render();
 					}
 					else if (h.getType() == PxGeometryType::eSPHERE)
 					{
-						glActiveTexture(GL_TEXTURE0);
-						glBindTexture(GL_TEXTURE_2D, texIds[physx_actors[i].actorId % 15]);
-						glUniform1i(TextureID, 0);
+						g_gl_state.bindTexture(0, GL_TEXTURE_2D, texIds[physx_actors[i].actorId % 15]);
+						g_gl_state.uniform1i(TextureID, 0);
 			
-						glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(mvp_mat));
+						g_gl_state.uniformMatrix4fv(ModelMatrixID, model_matrix);
 						mySphere.render();
 					}
 				}
@@ -520,13 +540,11 @@ int main(void)
 		// render ground plane
 		{
 			glm::mat4 model_matrix = glm::mat4(1.0);
-			glm::mat4 mvp_mat = g_proj_matrix * g_view_matrix * model_matrix;
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture_checker);
-			glUniform1i(TextureID, 0);
+			g_gl_state.bindTexture(0, GL_TEXTURE_2D, texture_checker);
+			g_gl_state.uniform1i(TextureID, 0);
 			
-			glUniformMatrix4fv(MatrixID, 1, GL_FALSE, glm::value_ptr(mvp_mat));
+			g_gl_state.uniformMatrix4fv(ModelMatrixID, glm::value_ptr(model_matrix));
 			myPlane.render();
 		}
 
@@ -541,12 +559,13 @@ int main(void)
 	myPlane.clear();
 	myBox.clear();
 	mySphere.clear();
+	cameraBuffer.clear();
 
-	glDeleteProgram(programID);
+	g_gl_state.deleteProgram(programID);
 
-	glDeleteTextures(1, &texture_crate);
-	glDeleteTextures(1, &texture_checker);
-	glDeleteTextures(num_ball_textures, texIds);
+	g_gl_state.deleteTextures(1, &texture_crate);
+	g_gl_state.deleteTextures(1, &texture_checker);
+	g_gl_state.deleteTextures(num_ball_textures, texIds);
 
 	// close ogl window and terminate glfw
 	glfwDestroyWindow(window);
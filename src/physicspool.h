@@ -0,0 +1,133 @@
+#ifndef PHYSICSPOOL_H
+#define PHYSICSPOOL_H
+
+#include <new>
+#include <utility>
+
+#include "LinearMath/btAlignedAllocator.h"
+#include "LinearMath/btAlignedObjectArray.h"
+
+// chunked pool for Bullet objects (16 byte aligned), destroyed objects go to a free list and are reused,
+// clear() hands every chunk back at once instead of one free per object
+template <typename T>
+class PhysicsObjectPool
+{
+public:
+	explicit PhysicsObjectPool(int chunkSize = 256)
+		: chunkSize(chunkSize), currentChunkSize(0), numSlotsUsed(0), capacity(0), reservedSlots(0), freeList(nullptr), numLive(0)
+	{
+	}
+
+	~PhysicsObjectPool()
+	{
+		clear();
+	}
+
+	template <typename... Args>
+	T* construct(Args&&... args)
+	{
+		void* slot = allocateSlot();
+		numLive++;
+
+		return new (slot) T(std::forward<Args>(args)...);
+	}
+
+	void destroy(T* obj)
+	{
+		if (!obj)
+			return;
+
+		obj->~T();
+
+		FreeSlot* slot = reinterpret_cast<FreeSlot*>(obj);
+		slot->next = freeList;
+		freeList = slot;
+		numLive--;
+	}
+
+	// make the next count constructions come from one contiguous chunk (free slots are skipped until then),
+	// the rest of the current chunk is left unused if it is too small
+	void reserve(int count)
+	{
+		if (currentChunkSize - numSlotsUsed < count)
+			addChunk(count > chunkSize ? count : chunkSize);
+
+		reservedSlots = count;
+	}
+
+	// release all chunks, live objects must have been destroyed before
+	void clear()
+	{
+		btAssert(numLive == 0);
+
+		for (int i = 0; i < chunks.size(); ++i)
+			btAlignedFree(chunks[i]);
+
+		chunks.clear();
+		currentChunkSize = 0;
+		numSlotsUsed = 0;
+		capacity = 0;
+		reservedSlots = 0;
+		freeList = nullptr;
+		numLive = 0;
+	}
+
+	int getNumLive() const
+	{
+		return numLive;
+	}
+
+	int getCapacity() const
+	{
+		return capacity;
+	}
+
+private:
+	struct FreeSlot
+	{
+		FreeSlot* next;
+	};
+
+	static const size_t slotSize = ((sizeof(T) > sizeof(FreeSlot) ? sizeof(T) : sizeof(FreeSlot)) + 15) & ~size_t(15);
+
+	void* allocateSlot()
+	{
+		if (freeList && reservedSlots == 0)
+		{
+			FreeSlot* slot = freeList;
+			freeList = slot->next;
+			return slot;
+		}
+
+		if (numSlotsUsed == currentChunkSize)
+			addChunk(chunkSize);
+
+		if (reservedSlots > 0)
+			reservedSlots--;
+
+		return static_cast<char*>(chunks[chunks.size() - 1]) + slotSize * numSlotsUsed++;
+	}
+
+	void addChunk(int size)
+	{
+		chunks.push_back(btAlignedAlloc(slotSize * size, 16));
+		currentChunkSize = size;
+		numSlotsUsed = 0;
+		capacity += size;
+	}
+
+	int chunkSize;
+	int currentChunkSize;
+	int numSlotsUsed;
+	int capacity;
+	int reservedSlots;
+	FreeSlot* freeList;
+	int numLive;
+
+	btAlignedObjectArray<void*> chunks;
+
+	PhysicsObjectPool(const PhysicsObjectPool& that);
+	PhysicsObjectPool& operator=(const PhysicsObjectPool& that);
+};
+
+#endif
@@ -0,0 +1,584 @@
+#include "physicsscene.h"
+#include "physicspool.h"
+#include "trackedmotionstate.h"
+#include "broadphaseprofiler.h"
+#include "hashgridbroadphase.h"
+#include "contactalgorithms.h"
+
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
+#include "LinearMath/btQuickprof.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
+
+#ifdef BT_THREADSAFE
+#include "LinearMath/btThreads.h"
+#include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+#include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+#include "BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h"
+#endif
+
+btDefaultCollisionConfiguration* collisionConfiguration;
+btCollisionDispatcher* dispatcher;
+btBroadphaseInterface* overlappingPairCache;
+btSequentialImpulseConstraintSolver* solver;
+btConstraintSolverPoolMt* solverPool = nullptr;
+btDiscreteDynamicsWorld* dynamicsWorld;
+
+// collision shape array, release memory at exit
+btAlignedObjectArray<btCollisionShape*> collisionShapes;
+
+// bodies and motion states live in pools, released as a whole by cleanupPhysics
+static PhysicsObjectPool<btRigidBody> rigidBodyPool;
+static PhysicsObjectPool<TrackedMotionState> motionStatePool;
+
+// shared collision shapes keyed by their creation parameters, each one is also owned by collisionShapes
+struct SharedShape
+{
+	int shapeType;
+	btVector3 dimensions;
+	btCollisionShape* shape;
+};
+static btAlignedObjectArray<SharedShape> sharedShapes;
+
+static btCollisionShape* findSharedShape(int shapeType, const btVector3& dimensions)
+{
+	for (int i = 0; i < sharedShapes.size(); ++i)
+	{
+		if (sharedShapes[i].shapeType == shapeType && sharedShapes[i].dimensions == dimensions)
+			return sharedShapes[i].shape;
+	}
+
+	return nullptr;
+}
+
+static btCollisionShape* addSharedShape(int shapeType, const btVector3& dimensions, btCollisionShape* shape)
+{
+	SharedShape shared;
+	shared.shapeType = shapeType;
+	shared.dimensions = dimensions;
+	shared.shape = shape;
+
+	sharedShapes.push_back(shared);
+	collisionShapes.push_back(shape);
+
+	return shape;
+}
+
+btCollisionShape* getBoxShape(const btVector3& halfExtents)
+{
+	btCollisionShape* shape = findSharedShape(BOX_SHAPE_PROXYTYPE, halfExtents);
+	if (!shape)
+		shape = addSharedShape(BOX_SHAPE_PROXYTYPE, halfExtents, new btBoxShape(halfExtents));
+
+	return shape;
+}
+
+btCollisionShape* getSphereShape(btScalar radius)
+{
+	btVector3 dimensions(radius, radius, radius);
+
+	btCollisionShape* shape = findSharedShape(SPHERE_SHAPE_PROXYTYPE, dimensions);
+	if (!shape)
+		shape = addSharedShape(SPHERE_SHAPE_PROXYTYPE, dimensions, new btSphereShape(radius));
+
+	return shape;
+}
+
+btRigidBody* createRigidBody(btScalar mass, const btTransform& startTransform, btCollisionShape* shape)
+{
+	// rigidbody is dynamic if and only if mass is non zero, otherwise static
+	bool isDynamic = (mass != 0.f);
+
+	btVector3 localInertia(0, 0, 0);
+	if (isDynamic)
+		shape->calculateLocalInertia(mass, localInertia);
+
+	// using motionstate is recommended, it provides interpolation capabilities, and only synchronizes 'active' objects
+	TrackedMotionState* myMotionState = motionStatePool.construct(startTransform);
+	btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, myMotionState, shape, localInertia);
+
+	return rigidBodyPool.construct(rbInfo);
+}
+
+void destroyRigidBody(btRigidBody* body)
+{
+	motionStatePool.destroy(static_cast<TrackedMotionState*>(body->getMotionState()));
+	rigidBodyPool.destroy(body);
+}
+
+// invoked for every body the scene creates
+static BodyCreatedCallback bodyCreatedCallback = nullptr;
+
+void setBodyCreatedCallback(BodyCreatedCallback callback)
+{
+	bodyCreatedCallback = callback;
+}
+
+void addRigidBodies(const RigidBodyDesc* descs, int count, btRigidBody** bodies)
+{
+	if (count <= 0)
+		return;
+
+	rigidBodyPool.reserve(count);
+	motionStatePool.reserve(count);
+	dynamicsWorld->getCollisionObjectArray().reserve(dynamicsWorld->getNumCollisionObjects() + count);
+
+	// with deferred collision a new proxy is only inserted, not queried against both trees
+	btDbvtBroadphase* dbvt = findDbvtBroadphase(dynamicsWorld->getBroadphase());
+	bool deferredCollide = dbvt && dbvt->m_deferedcollide;
+	if (dbvt)
+		dbvt->m_deferedcollide = true;
+
+	for (int i = 0; i < count; ++i)
+	{
+		btRigidBody* body = createRigidBody(descs[i].mass, descs[i].transform, descs[i].shape);
+
+		dynamicsWorld->addRigidBody(body);
+		if (bodies)
+			bodies[i] = body;
+		if (bodyCreatedCallback)
+			bodyCreatedCallback(body);
+	}
+
+	if (dbvt)
+	{
+		// balance the incrementally grown tree in one pass, then collect the pairs of all new proxies at once
+		dbvt->m_sets[btDbvtBroadphase::DYNAMIC_SET].optimizeTopDown();
+		dbvt->calculateOverlappingPairs(dynamicsWorld->getDispatcher());
+		dbvt->m_deferedcollide = deferredCollide;
+	}
+}
+
+bool parsePhysicsSceneArg(int argc, char* argv[], int& i, PhysicsSceneConfig& config)
+{
+	if (i + 1 >= argc)
+		return false;
+
+	if (strcmp(argv[i], "--layers") == 0)
+		config.numLayers = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--boxes") == 0)
+		config.numBoxesPerLayer = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--radius") == 0)
+		config.ringRadius = static_cast<float>(atof(argv[++i]));
+	else if (strcmp(argv[i], "--spheres") == 0)
+		config.numSpheres = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--broadphase") == 0)
+	{
+		const char* name = argv[++i];
+		if (strcmp(name, "dbvt") == 0)
+			config.broadphase = BroadphaseType::Dbvt;
+		else if (strcmp(name, "sap") == 0)
+			config.broadphase = BroadphaseType::AxisSweep;
+		else if (strcmp(name, "sap32") == 0)
+			config.broadphase = BroadphaseType::AxisSweep32;
+		else if (strcmp(name, "simple") == 0)
+			config.broadphase = BroadphaseType::Simple;
+		else if (strcmp(name, "grid") == 0)
+			config.broadphase = BroadphaseType::HashGrid;
+		else
+			return false;
+	}
+	else if (strcmp(argv[i], "--grid-cell") == 0)
+		config.gridCellSize = static_cast<float>(atof(argv[++i]));
+	else if (strcmp(argv[i], "--default-algorithms") == 0)
+		config.customContactAlgorithms = false;
+	else if (strcmp(argv[i], "--threads") == 0)
+		config.numThreads = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--scheduler") == 0)
+	{
+		const char* name = argv[++i];
+		if (strcmp(name, "sequential") == 0)
+			config.taskScheduler = TaskSchedulerType::Sequential;
+		else if (strcmp(name, "internal") == 0)
+			config.taskScheduler = TaskSchedulerType::Internal;
+		else if (strcmp(name, "omp") == 0)
+			config.taskScheduler = TaskSchedulerType::OpenMP;
+		else if (strcmp(name, "tbb") == 0)
+			config.taskScheduler = TaskSchedulerType::TBB;
+		else
+			return false;
+	}
+	else
+		return false;
+
+	return true;
+}
+
+#ifdef BT_THREADSAFE
+// Bullet's internal scheduler is created on demand and owned here, OpenMP/TBB ones are singletons
+static btITaskScheduler* ownedTaskScheduler = nullptr;
+
+static btITaskScheduler* createTaskScheduler(TaskSchedulerType type)
+{
+	switch (type)
+	{
+	case TaskSchedulerType::Sequential:
+		return btGetSequentialTaskScheduler();
+	case TaskSchedulerType::Internal:
+		ownedTaskScheduler = btCreateDefaultTaskScheduler();
+		return ownedTaskScheduler;
+	case TaskSchedulerType::OpenMP:
+		return btGetOpenMPTaskScheduler();
+	case TaskSchedulerType::TBB:
+		return btGetTBBTaskScheduler();
+	}
+
+	return nullptr;
+}
+#endif
+
+const char* getBroadphaseName(BroadphaseType type)
+{
+	switch (type)
+	{
+	case BroadphaseType::Dbvt:
+		return "dbvt";
+	case BroadphaseType::AxisSweep:
+		return "sap";
+	case BroadphaseType::AxisSweep32:
+		return "sap32";
+	case BroadphaseType::Simple:
+		return "simple";
+	case BroadphaseType::HashGrid:
+		return "grid";
+	}
+
+	return "unknown";
+}
+
+// spheres are stacked in a block of sphereGridSide x sphereGridSide columns above the tower
+static const btScalar sphereRadius = 1.0f;
+static const btScalar sphereSpacing = 2.5f;
+
+static int getSphereGridSide(const PhysicsSceneConfig& config)
+{
+	int side = static_cast<int>(ceil(sqrt(static_cast<double>(config.numSpheres))));
+	return btMax(side, 1);
+}
+
+static btScalar getTowerHeight(const PhysicsSceneConfig& config)
+{
+	return btScalar(2.0f * config.numLayers);
+}
+
+void getSceneBounds(const PhysicsSceneConfig& config, btVector3& aabbMin, btVector3& aabbMax)
+{
+	// the boxes' half length is 2, the ground plane's proxy is infinite and gets clamped anyway
+	btScalar towerRadius = config.ringRadius + 2.5f;
+	aabbMin.setValue(-towerRadius, 0, -towerRadius);
+	aabbMax.setValue(towerRadius, getTowerHeight(config), towerRadius);
+
+	if (config.numSpheres > 0)
+	{
+		int side = getSphereGridSide(config);
+		int layers = (config.numSpheres + side * side - 1) / (side * side);
+		btScalar halfWidth = side * sphereSpacing * 0.5f;
+		aabbMin.setMin(btVector3(-halfWidth, 0, -halfWidth));
+		aabbMax.setMax(btVector3(halfWidth, getTowerHeight(config) + 10.0f + layers * sphereSpacing, halfWidth));
+	}
+
+	btVector3 extent(config.worldExtent, config.worldExtent, config.worldExtent);
+	aabbMin.setMin(-extent);
+	aabbMax.setMax(extent);
+}
+
+btBroadphaseInterface* createBroadphase(const PhysicsSceneConfig& config)
+{
+	btBroadphaseInterface* broadphase = nullptr;
+
+	// the fixed size broadphases need a handle per proxy: the ground, the tower and the spheres
+	int maxProxies = 1 + config.numLayers * config.numBoxesPerLayer + config.numSpheres + config.extraProxies;
+
+	btVector3 worldMin, worldMax;
+	getSceneBounds(config, worldMin, worldMax);
+
+	switch (config.broadphase)
+	{
+	case BroadphaseType::Dbvt:
+		broadphase = new btDbvtBroadphase();
+		break;
+	case BroadphaseType::AxisSweep:
+		// 16 bit handles, one is reserved as sentinel
+		if (maxProxies > 32766)
+		{
+			fprintf(stderr, "sap broadphase is limited to 32766 proxies, use sap32 for %d.\n", maxProxies);
+			maxProxies = 32766;
+		}
+		broadphase = new btAxisSweep3(worldMin, worldMax, static_cast<unsigned short>(maxProxies));
+		break;
+	case BroadphaseType::AxisSweep32:
+		broadphase = new bt32BitAxisSweep3(worldMin, worldMax, static_cast<unsigned int>(maxProxies));
+		break;
+	case BroadphaseType::Simple:
+		broadphase = new btSimpleBroadphase(maxProxies);
+		break;
+	case BroadphaseType::HashGrid:
+		broadphase = new HashGridBroadphase(config.gridCellSize);
+		break;
+	}
+
+	if (config.profileBroadphase)
+		broadphase = new ProfiledBroadphase(broadphase);
+
+	return broadphase;
+}
+
+// the scene initPhysics was called with, rebuilt by resetPhysicsScene
+static PhysicsSceneConfig sceneConfig;
+static btCollisionShape* groundShape = nullptr;
+
+static void createScene(const PhysicsSceneConfig& config)
+{
+	// create a few basic rigid bodies
+
+	// ground plane
+	{
+		btTransform groundTransform;
+		groundTransform.setIdentity();
+		groundTransform.setOrigin(btVector3(0, 0, 0));
+
+		btScalar mass(0.f);
+
+		btRigidBody* body = createRigidBody(mass, groundTransform, groundShape);
+
+		// add the body to the dynamics world
+		dynamicsWorld->addRigidBody(body);
+	}
+	
+	{
+		// all boxes share one shape
+		btCollisionShape* colShape = getBoxShape(btVector3(btScalar(1.125), btScalar(1.0), btScalar(2.0)));
+		btScalar mass(0.25f);
+		float rad = config.ringRadius;
+		float ring = static_cast<float>(config.numBoxesPerLayer);
+
+		btAlignedObjectArray<RigidBodyDesc> descs;
+		descs.reserve(config.numLayers * config.numBoxesPerLayer);
+
+		for (int j = 0; j < config.numLayers; j++)
+		{
+			for (int i = 0; i < config.numBoxesPerLayer; i++)
+			{
+				RigidBodyDesc desc;
+				desc.shape = colShape;
+				desc.mass = mass;
+
+				btTransform& startTransform = desc.transform;
+				startTransform.setIdentity();
+
+				startTransform.setOrigin(btVector3(rad * cos(2.0f * static_cast<float>(M_PI) * (i + static_cast<float>(j % 2) / 2.0f) / ring), 1.0f + j * 2.0f, -rad * sin(2.0f * static_cast<float>(M_PI) * (i + static_cast<float>(j % 2) / 2.0f) / ring)));
+				startTransform.setRotation(btQuaternion(btVector3(btScalar(0), btScalar(1), btScalar(0)), btScalar((i + static_cast<float>(j % 2) / 2.0f) * 2.0f * static_cast<float>(M_PI) / ring)));
+
+				descs.push_back(desc);
+			}
+		}
+
+		// the whole tower is added with one broadphase build
+		if (descs.size() > 0)
+		{
+			addRigidBodies(&descs[0], descs.size());
+		}
+	}
+
+	if (config.numSpheres > 0)
+	{
+		// a block of spheres centered above the tower, falling onto it once the simulation starts
+		btCollisionShape* colShape = getSphereShape(sphereRadius);
+		int side = getSphereGridSide(config);
+		btScalar offset = (side - 1) * sphereSpacing * 0.5f;
+		btScalar bottom = getTowerHeight(config) + 10.0f;
+
+		btAlignedObjectArray<RigidBodyDesc> descs;
+		descs.resize(config.numSpheres);
+
+		for (int i = 0; i < config.numSpheres; i++)
+		{
+			int x = i % side;
+			int z = (i / side) % side;
+			int y = i / (side * side);
+
+			RigidBodyDesc& desc = descs[i];
+			desc.shape = colShape;
+			desc.mass = 0.5f;
+			desc.transform.setIdentity();
+			desc.transform.setOrigin(btVector3(x * sphereSpacing - offset, bottom + y * sphereSpacing, z * sphereSpacing - offset));
+		}
+
+		addRigidBodies(&descs[0], descs.size());
+	}
+}
+
+void initPhysics(const PhysicsSceneConfig& config)
+{
+	// collision configuration contains default setup for memory, collision setup
+	collisionConfiguration = new btDefaultCollisionConfiguration();
+
+	// the dbvt is the general purpose broadphase, sweep and prune needs the world bounds up front
+	overlappingPairCache = createBroadphase(config);
+
+	bool multithreaded = config.numThreads > 0;
+#ifdef BT_THREADSAFE
+	btITaskScheduler* scheduler = multithreaded ? createTaskScheduler(config.taskScheduler) : nullptr;
+	if (multithreaded && !scheduler)
+	{
+		fprintf(stderr, "requested task scheduler is not available in this Bullet build, running single threaded.\n");
+		multithreaded = false;
+	}
+
+	if (multithreaded)
+	{
+		scheduler->setNumThreads(btMin(config.numThreads, scheduler->getMaxNumThreads()));
+		btSetTaskScheduler(scheduler);
+
+		printf("bullet task scheduler: %s, %d threads\n", scheduler->getName(), scheduler->getNumThreads());
+
+		// collision pairs are dispatched in parallel
+		dispatcher = new btCollisionDispatcherMt(collisionConfiguration);
+
+		// islands are solved in parallel by a pool of solvers, large islands by the multithreaded solver
+		solverPool = new btConstraintSolverPoolMt(scheduler->getNumThreads());
+		solver = new btSequentialImpulseConstraintSolverMt;
+
+		dynamicsWorld = new btDiscreteDynamicsWorldMt(dispatcher, overlappingPairCache, solverPool, solver, collisionConfiguration);
+	}
+#else
+	if (multithreaded)
+	{
+		fprintf(stderr, "multithreaded world requires Bullet built with BT_THREADSAFE, running single threaded.\n");
+		multithreaded = false;
+	}
+#endif
+
+	if (!multithreaded)
+	{
+		// default collision dispatcher
+		dispatcher = new btCollisionDispatcher(collisionConfiguration);
+
+		// default constraint solver
+		solver = new btSequentialImpulseConstraintSolver;
+
+		dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, overlappingPairCache, solver, collisionConfiguration);
+	}
+
+	if (config.customContactAlgorithms)
+		registerContactAlgorithms(dispatcher);
+
+	dynamicsWorld->setGravity(btVector3(0, -10, 0));
+
+	// the grid skips proxies whose bounds did not change, the world can skip computing them for sleeping bodies
+	if (config.broadphase == BroadphaseType::HashGrid)
+		dynamicsWorld->setForceUpdateAllAabbs(false);
+
+	// one ground shape for every rebuild of the scene
+	groundShape = new btStaticPlaneShape(btVector3(btScalar(0), btScalar(1), btScalar(0)), btScalar(0));
+	collisionShapes.push_back(groundShape);
+
+	sceneConfig = config;
+	createScene(sceneConfig);
+}
+
+void cleanupPhysics()
+{
+	// cleanup in the reverse order of creation/initialization
+
+	// remove the rigidbodies from the dynamics world and destroy them, the pool memory is released at once below
+	clearPhysicsWorld();
+
+	rigidBodyPool.clear();
+	motionStatePool.clear();
+
+	// delete collision shapes
+	for (int j = 0; j < collisionShapes.size(); j++)
+	{
+		btCollisionShape* shape = collisionShapes[j];
+		collisionShapes[j] = 0;
+		delete shape;
+	}
+	sharedShapes.clear();
+	groundShape = nullptr;
+
+	// delete dynamics world
+	delete dynamicsWorld;
+
+	// delete solver
+	delete solver;
+#ifdef BT_THREADSAFE
+	delete solverPool;
+	solverPool = nullptr;
+#endif
+
+	// delete broadphase
+	delete overlappingPairCache;
+
+	// delete dispatcher
+	delete dispatcher;
+
+	delete collisionConfiguration;
+
+#ifdef BT_THREADSAFE
+	btSetTaskScheduler(btGetSequentialTaskScheduler());
+	delete ownedTaskScheduler;
+	ownedTaskScheduler = nullptr;
+#endif
+
+	// next line is optional: it will be cleared by the destructor when the array goes out of scope
+	collisionShapes.clear();
+}
+
+// removes every pair it is shown, which also destroys the pair's algorithm and its manifold
+struct RemoveAllPairsCallback : public btOverlapCallback
+{
+	virtual bool processOverlap(btBroadphasePair& pair)
+	{
+		return true;
+	}
+};
+
+void clearPhysicsWorld()
+{
+	btAssert(dynamicsWorld->getNumConstraints() == 0);
+
+	btBroadphaseInterface* broadphase = dynamicsWorld->getBroadphase();
+	btDispatcher* worldDispatcher = dynamicsWorld->getDispatcher();
+
+	RemoveAllPairsCallback removeAllPairs;
+	broadphase->getOverlappingPairCache()->processAllOverlappingPairs(&removeAllPairs, worldDispatcher);
+
+	// the pair cache is empty, destroying a proxy only takes its leaf out of the tree
+	btCollisionObjectArray& objects = dynamicsWorld->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); ++i)
+	{
+		btCollisionObject* obj = objects[i];
+		if (obj->getBroadphaseHandle())
+		{
+			broadphase->destroyProxy(obj->getBroadphaseHandle(), worldDispatcher);
+			obj->setBroadphaseHandle(nullptr);
+		}
+
+		btRigidBody* body = btRigidBody::upcast(obj);
+		if (body)
+			destroyRigidBody(body);
+		else
+			delete obj;
+	}
+
+	objects.clear();
+	dynamicsWorld->getNonStaticRigidBodies().clear();
+
+	// let the broadphase release its tree nodes now that it has no proxies left
+	broadphase->resetPool(worldDispatcher);
+}
+
+void resetPhysicsScene()
+{
+	clearPhysicsWorld();
+	createScene(sceneConfig);
+}
+
+void stepPhysics()
+{
+	dynamicsWorld->stepSimulation(1.f / 60.f, 10);
+}
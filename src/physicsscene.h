@@ -0,0 +1,114 @@
+#ifndef PHYSICSSCENE_H
+#define PHYSICSSCENE_H
+
+#include "btBulletDynamicsCommon.h"
+
+class btConstraintSolverPoolMt;
+
+// task schedulers for btDiscreteDynamicsWorldMt, availability depends on how Bullet was built
+enum class TaskSchedulerType
+{
+	Sequential,
+	Internal,
+	OpenMP,
+	TBB
+};
+
+// broadphase of the world, the sweep and prune variants quantize positions into the world bounds
+enum class BroadphaseType
+{
+	Dbvt,
+	AxisSweep,
+	AxisSweep32,
+	Simple,
+	HashGrid
+};
+
+const char* getBroadphaseName(BroadphaseType type);
+
+// tower of boxes arranged in rings, layers are rotated by half a box against each other,
+// optionally with a block of spheres above it that falls onto the tower
+struct PhysicsSceneConfig
+{
+	int numLayers = 24;
+	int numBoxesPerLayer = 16;
+	float ringRadius = 12.0f;
+	int numSpheres = 0;
+
+	BroadphaseType broadphase = BroadphaseType::Dbvt;
+	// half size of the cube around the origin bodies are expected to stay in, grown to contain the scene
+	float worldExtent = 500.0f;
+	// the fixed size broadphases get room for this many proxies on top of the scene's bodies
+	int extraProxies = 4096;
+	// finest cell size of the HashGridBroadphase, fits the tower's boxes in any orientation
+	float gridCellSize = 5.0f;
+	// wrap the broadphase in a ProfiledBroadphase
+	bool profileBroadphase = false;
+
+	// replace Bullet's narrowphase for box, sphere and plane pairs with the ones in contactalgorithms.h
+	bool customContactAlgorithms = true;
+
+	// numThreads > 0 selects the multithreaded world (requires BT_THREADSAFE)
+	int numThreads = 0;
+	TaskSchedulerType taskScheduler = TaskSchedulerType::Internal;
+};
+
+// parse the scene options shared by all executables at argv[i], advances i past consumed values
+// --layers N, --boxes N, --radius R, --spheres N, --threads N, --scheduler sequential|internal|omp|tbb,
+// --broadphase dbvt|sap|sap32|simple|grid, --grid-cell S, --default-algorithms
+bool parsePhysicsSceneArg(int argc, char* argv[], int& i, PhysicsSceneConfig& config);
+
+extern btDefaultCollisionConfiguration* collisionConfiguration;
+extern btCollisionDispatcher* dispatcher;
+extern btBroadphaseInterface* overlappingPairCache;
+extern btSequentialImpulseConstraintSolver* solver;
+extern btConstraintSolverPoolMt* solverPool;
+extern btDiscreteDynamicsWorld* dynamicsWorld;
+
+// collision shape array, release memory at exit
+extern btAlignedObjectArray<btCollisionShape*> collisionShapes;
+
+// shared collision shapes, one instance per unique geometry, owned by collisionShapes
+btCollisionShape* getBoxShape(const btVector3& halfExtents);
+btCollisionShape* getSphereShape(btScalar radius);
+
+// body and motion state (a TrackedMotionState) are taken from pools, a destroyed body must have been removed from the world
+btRigidBody* createRigidBody(btScalar mass, const btTransform& startTransform, btCollisionShape* shape);
+void destroyRigidBody(btRigidBody* body);
+
+// one body of a bulk insertion
+ATTRIBUTE_ALIGNED16(struct) RigidBodyDesc
+{
+	btTransform transform;
+	btCollisionShape* shape;
+	btScalar mass;
+};
+
+// create count bodies from contiguous pool memory and add them to the world. a btDbvtBroadphase only
+// inserts their proxies, its tree is rebuilt top down once at the end and the new pairs are found with a
+// single tree against tree query instead of one query per body. bodies receives the created bodies if not null
+void addRigidBodies(const RigidBodyDesc* descs, int count, btRigidBody** bodies = nullptr);
+
+typedef void (*BodyCreatedCallback)(btRigidBody* body);
+
+// register e.g. the renderer before initPhysics to get notified about every created body
+void setBodyCreatedCallback(BodyCreatedCallback callback);
+
+// world bounds of the scene, the bodies' initial positions and the world extent
+void getSceneBounds(const PhysicsSceneConfig& config, btVector3& aabbMin, btVector3& aabbMax);
+btBroadphaseInterface* createBroadphase(const PhysicsSceneConfig& config);
+
+void initPhysics(const PhysicsSceneConfig& config = PhysicsSceneConfig());
+void stepPhysics();
+void cleanupPhysics();
+
+// remove and destroy every collision object in one pass: all pairs with their algorithms and manifolds
+// are released first, so destroying the proxies afterwards has no pairs to search, and the world arrays
+// are cleared at once instead of one linear removal per object. the world must have no constraints
+void clearPhysicsWorld();
+
+// clear the world and build the scene initPhysics created again, callers with a physics thread must
+// hold the world lock and drop their references to the old bodies (renderer, projectiles) before
+void resetPhysicsScene();
+
+#endif
@@ -0,0 +1,143 @@
+#include "physicsthread.h"
+
+#include <chrono>
+
+static double wallClockSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool PhysicsSnapshot::getTransform(const btCollisionObject* obj, float alpha, btTransform& transform) const
+{
+	int index = obj->getWorldArrayIndex();
+	if (index < 0 || index >= static_cast<int>(entries.size()) || entries[index].object != obj)
+		return false;
+
+	const Entry& entry = entries[index];
+	transform.setOrigin(entry.prevOrigin.lerp(entry.origin, btScalar(alpha)));
+	transform.setRotation(slerp(entry.prevRotation, entry.rotation, btScalar(alpha)));
+
+	return true;
+}
+
+bool PhysicsSnapshot::isAtRest(const btCollisionObject* obj) const
+{
+	int index = obj->getWorldArrayIndex();
+	if (index < 0 || index >= static_cast<int>(entries.size()) || entries[index].object != obj)
+		return false;
+
+	return !entries[index].active;
+}
+
+void PhysicsSnapshot::capture(const btCollisionWorld* world, const std::vector<Entry>& previousStep)
+{
+	const btCollisionObjectArray& objects = world->getCollisionObjectArray();
+	entries.resize(objects.size());
+
+	for (int i = 0; i < objects.size(); ++i)
+	{
+		const btCollisionObject* obj = objects[i];
+		const btTransform& transform = obj->getWorldTransform();
+
+		Entry& entry = entries[i];
+		entry.object = obj;
+		entry.origin = transform.getOrigin();
+		entry.rotation = transform.getRotation();
+		entry.active = obj->isActive();
+
+		if (i < static_cast<int>(previousStep.size()) && previousStep[i].object == obj)
+		{
+			entry.prevOrigin = previousStep[i].origin;
+			entry.prevRotation = previousStep[i].rotation;
+		}
+		else
+		{
+			entry.prevOrigin = entry.origin;
+			entry.prevRotation = entry.rotation;
+		}
+	}
+}
+
+PhysicsThread::PhysicsThread(btDynamicsWorld* world, double fixedTimeStep)
+	: world(world), fixedTimeStep(fixedTimeStep), running(false), back(0), front(1), middle(2)
+{
+	for (int i = 0; i < 3; ++i)
+		snapshots[i].time = 0.0;
+}
+
+PhysicsThread::~PhysicsThread()
+{
+	stop();
+}
+
+void PhysicsThread::start()
+{
+	if (running)
+		return;
+
+	// publish the initial state so the renderer has something to draw before the first step
+	captureSnapshot(snapshots[back]);
+	back = middle.exchange(back | freshBit) & ~freshBit;
+
+	running = true;
+	thread = std::thread(&PhysicsThread::run, this);
+}
+
+void PhysicsThread::stop()
+{
+	running = false;
+	if (thread.joinable())
+		thread.join();
+}
+
+const PhysicsSnapshot& PhysicsThread::acquireSnapshot()
+{
+	if (middle.load() & freshBit)
+		front = middle.exchange(front) & ~freshBit;
+
+	return snapshots[front];
+}
+
+float PhysicsThread::getInterpolationAlpha(const PhysicsSnapshot& snapshot) const
+{
+	float alpha = static_cast<float>((wallClockSeconds() - snapshot.time) / fixedTimeStep);
+	return btMax(0.0f, btMin(alpha, 1.0f));
+}
+
+void PhysicsThread::captureSnapshot(PhysicsSnapshot& snapshot)
+{
+	snapshot.capture(world, lastStep);
+
+	// the back buffer holds a state two publishes old, keep a private copy of this step instead
+	lastStep = snapshot.entries;
+
+	snapshot.time = wallClockSeconds();
+}
+
+void PhysicsThread::run()
+{
+	typedef std::chrono::steady_clock clock;
+	const clock::duration step = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(fixedTimeStep));
+
+	clock::time_point next = clock::now();
+	while (running)
+	{
+		{
+			std::lock_guard<std::mutex> lock(worldMutex);
+
+			world->stepSimulation(btScalar(fixedTimeStep), 1, btScalar(fixedTimeStep));
+			captureSnapshot(snapshots[back]);
+		}
+
+		// hand the written buffer to the reader and take the stale one back
+		back = middle.exchange(back | freshBit) & ~freshBit;
+
+		// a step that overran the budget starts a new schedule instead of bursting to catch up
+		next += step;
+		clock::time_point now = clock::now();
+		if (next < now)
+			next = now;
+		else
+			std::this_thread::sleep_until(next);
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "btBulletDynamicsCommon.h"
+
+// transforms of the last two fixed steps, indexed by the collision object world array index
+struct PhysicsSnapshot
+{
+	struct Entry
+	{
+		const btCollisionObject* object;
+		btVector3 prevOrigin;
+		btVector3 origin;
+		btQuaternion prevRotation;
+		btQuaternion rotation;
+		bool active;
+	};
+
+	double time; // wall clock time in seconds when the latest step finished
+	std::vector<Entry> entries;
+
+	// copy the current world transforms, the previous ones are taken from previousStep where the object matches
+	void capture(const btCollisionWorld* world, const std::vector<Entry>& previousStep);
+
+	// interpolate between the previous and the latest step, alpha in [0, 1]
+	// returns false if the object was not part of the world when the snapshot was taken
+	bool getTransform(const btCollisionObject* obj, float alpha, btTransform& transform) const;
+
+	// true if the object was deactivated (sleeping) in the latest step, its transform did not change
+	bool isAtRest(const btCollisionObject* obj) const;
+};
+
+// steps a dynamics world at a fixed rate on its own thread and publishes the results
+// through a triple buffer, so neither a slow frame nor a slow step stalls the other side
+class PhysicsThread
+{
+public:
+	PhysicsThread(btDynamicsWorld* world, double fixedTimeStep);
+	~PhysicsThread();
+
+	void start();
+	void stop();
+
+	double getFixedTimeStep() const
+	{
+		return fixedTimeStep;
+	}
+
+	// every world mutation from another thread (adding, removing bodies) must hold this lock
+	std::unique_lock<std::mutex> lockWorld()
+	{
+		return std::unique_lock<std::mutex>(worldMutex);
+	}
+
+	// forget the previous step so the next snapshot does not interpolate from bodies of a cleared scene,
+	// callers must hold the world lock
+	void discardHistory()
+	{
+		lastStep.clear();
+	}
+
+	// latest published snapshot, stays valid until the next call on the render thread
+	const PhysicsSnapshot& acquireSnapshot();
+
+	// interpolation factor for rendering the acquired snapshot one fixed step behind the simulation
+	float getInterpolationAlpha(const PhysicsSnapshot& snapshot) const;
+
+protected:
+	void run();
+	void captureSnapshot(PhysicsSnapshot& snapshot);
+
+	btDynamicsWorld* world;
+	double fixedTimeStep;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::mutex worldMutex;
+
+	// triple buffer, the writer owns back, the reader owns front, middle is exchanged atomically
+	static const int freshBit = 4;
+	PhysicsSnapshot snapshots[3];
+	int back;
+	int front;
+	std::atomic<int> middle;
+
+	// written and read by the physics thread only
+	std::vector<PhysicsSnapshot::Entry> lastStep;
+
+private:
+	PhysicsThread(const PhysicsThread& that);
+	PhysicsThread& operator=(const PhysicsThread& that);
+};
+
+#endif
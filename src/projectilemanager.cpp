@@ -0,0 +1,130 @@
+#include "projectilemanager.h"
+#include "physicsscene.h"
+
+ProjectileManager::ProjectileManager(btDiscreteDynamicsWorld* world, const ProjectileConfig& config)
+	: world(world), config(config), onSpawn(nullptr), onRetire(nullptr)
+{
+	if (config.maxProjectiles > 0)
+	{
+		live.reserve(config.maxProjectiles);
+		freeBodies.reserve(config.maxProjectiles);
+	}
+}
+
+ProjectileManager::~ProjectileManager()
+{
+	clear();
+}
+
+void ProjectileManager::setCallbacks(ProjectileCallback spawnCallback, ProjectileCallback retireCallback)
+{
+	onSpawn = spawnCallback;
+	onRetire = retireCallback;
+}
+
+btRigidBody* ProjectileManager::takeFreeBody(btCollisionShape* shape, btScalar mass)
+{
+	btScalar invMass = mass != btScalar(0) ? btScalar(1) / mass : btScalar(0);
+
+	for (size_t i = 0; i < freeBodies.size(); ++i)
+	{
+		btRigidBody* body = freeBodies[i];
+		if (body->getCollisionShape() == shape && body->getInvMass() == invMass)
+		{
+			freeBodies[i] = freeBodies.back();
+			freeBodies.pop_back();
+			return body;
+		}
+	}
+
+	return nullptr;
+}
+
+btRigidBody* ProjectileManager::spawn(btCollisionShape* shape, btScalar mass, const btVector3& position, const btVector3& linearVelocity)
+{
+	// make room by recycling the oldest projectile
+	if (config.maxProjectiles > 0 && static_cast<int>(live.size()) >= config.maxProjectiles)
+	{
+		retire(live.front().body);
+		live.erase(live.begin());
+	}
+
+	btTransform startTransform;
+	startTransform.setIdentity();
+	startTransform.setOrigin(position);
+
+	btRigidBody* body = takeFreeBody(shape, mass);
+	if (body)
+	{
+		// reset the retired body to a freshly created state
+		body->setWorldTransform(startTransform);
+		body->setInterpolationWorldTransform(startTransform);
+		body->getMotionState()->setWorldTransform(startTransform);
+		body->setAngularVelocity(btVector3(0, 0, 0));
+		body->setInterpolationAngularVelocity(btVector3(0, 0, 0));
+		body->clearForces();
+		body->forceActivationState(ACTIVE_TAG);
+		body->setDeactivationTime(btScalar(0));
+	}
+	else
+	{
+		body = createRigidBody(mass, startTransform, shape);
+	}
+
+	body->setLinearVelocity(linearVelocity);
+	body->setInterpolationLinearVelocity(linearVelocity);
+
+	world->addRigidBody(body);
+
+	Projectile projectile;
+	projectile.body = body;
+	projectile.age = btScalar(0);
+	live.push_back(projectile);
+
+	if (onSpawn)
+		onSpawn(body);
+
+	return body;
+}
+
+void ProjectileManager::retire(btRigidBody* body)
+{
+	if (onRetire)
+		onRetire(body);
+
+	world->removeRigidBody(body);
+	freeBodies.push_back(body);
+}
+
+void ProjectileManager::update(btScalar timeStep)
+{
+	// compact in place so the live list stays in spawn order
+	size_t numKept = 0;
+	for (size_t i = 0; i < live.size(); ++i)
+	{
+		Projectile& projectile = live[i];
+		projectile.age += timeStep;
+
+		const btVector3& pos = projectile.body->getWorldTransform().getOrigin();
+		bool expired = config.timeToLive > 0.0f && projectile.age > config.timeToLive;
+		bool outOfBounds =
+			pos.x() < config.boundsMin.x() || pos.y() < config.boundsMin.y() || pos.z() < config.boundsMin.z() ||
+			pos.x() > config.boundsMax.x() || pos.y() > config.boundsMax.y() || pos.z() > config.boundsMax.z();
+
+		if (expired || outOfBounds)
+			retire(projectile.body);
+		else
+			live[numKept++] = projectile;
+	}
+
+	live.resize(numKept);
+}
+
+void ProjectileManager::clear()
+{
+	for (size_t i = 0; i < freeBodies.size(); ++i)
+		destroyRigidBody(freeBodies[i]);
+
+	freeBodies.clear();
+	live.clear();
+}
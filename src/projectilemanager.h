@@ -0,0 +1,77 @@
+#ifndef PROJECTILEMANAGER_H
+#define PROJECTILEMANAGER_H
+
+#include <vector>
+
+#include "btBulletDynamicsCommon.h"
+
+struct ProjectileConfig
+{
+	// live projectiles, the oldest one is recycled when a new one exceeds the cap
+	int maxProjectiles = 256;
+
+	// seconds until a projectile is retired, <= 0 keeps projectiles until they leave the bounds
+	float timeToLive = 20.0f;
+
+	// projectiles leaving this box are retired
+	btVector3 boundsMin = btVector3(-500, -50, -500);
+	btVector3 boundsMax = btVector3(500, 500, 500);
+};
+
+typedef void (*ProjectileCallback)(btRigidBody* body);
+
+// owns fired bodies, retires them by cap, age and bounds and keeps retired bodies on a free list,
+// a spawn reuses a retired body with the same shape and mass instead of allocating a new one
+class ProjectileManager
+{
+public:
+	ProjectileManager(btDiscreteDynamicsWorld* world, const ProjectileConfig& config = ProjectileConfig());
+	~ProjectileManager();
+
+	// onSpawn runs after the body was (re)added to the world, onRetire before it is removed
+	void setCallbacks(ProjectileCallback onSpawn, ProjectileCallback onRetire);
+
+	btRigidBody* spawn(btCollisionShape* shape, btScalar mass, const btVector3& position, const btVector3& linearVelocity);
+
+	// age the projectiles by timeStep seconds and retire expired or out of bounds ones
+	// callers with a physics thread must hold the world lock
+	void update(btScalar timeStep);
+
+	// destroy the free list, live projectiles stay in the world and are released by cleanupPhysics
+	void clear();
+
+	int getNumLive() const
+	{
+		return static_cast<int>(live.size());
+	}
+
+	int getNumFree() const
+	{
+		return static_cast<int>(freeBodies.size());
+	}
+
+private:
+	struct Projectile
+	{
+		btRigidBody* body;
+		btScalar age;
+	};
+
+	btRigidBody* takeFreeBody(btCollisionShape* shape, btScalar mass);
+	void retire(btRigidBody* body);
+
+	btDiscreteDynamicsWorld* world;
+	ProjectileConfig config;
+
+	ProjectileCallback onSpawn;
+	ProjectileCallback onRetire;
+
+	// in spawn order, the oldest projectile comes first
+	std::vector<Projectile> live;
+	std::vector<btRigidBody*> freeBodies;
+
+	ProjectileManager(const ProjectileManager& that);
+	ProjectileManager& operator=(const ProjectileManager& that);
+};
+
+#endif
@@ -0,0 +1,614 @@
+#include "renderbuckets.h"
+#include "physicsthread.h"
+#include "frustum.h"
+#include "glringbuffer.h"
+#include "glrenderqueue.h"
+#include "glstatecache.h"
+#include "glstats.h"
+#include "trackedmotionstate.h"
+#include "broadphaseprofiler.h"
+
+#include <algorithm>
+
+#include "BulletCollision/BroadphaseCollision/btDbvtBroadphase.h"
+
+RenderBuckets::RenderBuckets()
+	: numVisible(0), lodEye(0, 0, 0), lodScale(0.0f), impostors(nullptr), impostorProgram(0), impostorDistance(0.0f), impostorDepth(0.0f), renderQueue(nullptr), meshProgram(0), streamBuffer(nullptr), staticBatchFrames(60)
+{
+}
+
+RenderBuckets::~RenderBuckets()
+{
+	clear();
+}
+
+void RenderBuckets::clear()
+{
+	for (size_t b = 0; b < buckets.size(); ++b)
+	{
+		delete buckets[b].lods;
+		buckets[b].lods = nullptr;
+
+		if (buckets[b].staticBuffer)
+		{
+			g_gl_state.deleteBuffer(buckets[b].staticBuffer);
+			buckets[b].staticBuffer = 0;
+		}
+	}
+
+	buckets.clear();
+	numVisible = 0;
+}
+
+void RenderBuckets::clearBodies()
+{
+	for (size_t b = 0; b < buckets.size(); ++b)
+	{
+		RenderBucket& bucket = buckets[b];
+		bucket.bodies.clear();
+		bucket.instances.clear();
+		bucket.visible.clear();
+		bucket.restFrames.clear();
+		bucket.inStaticBatch.clear();
+		bucket.lodLevels.clear();
+
+		bucket.numStatic = 0;
+		bucket.staticDirty = false;
+	}
+
+	numVisible = 0;
+}
+
+int RenderBuckets::findOrCreateBucket(const btCollisionShape* shape)
+{
+	RenderBucket key;
+	key.shapeType = shape->getShapeType();
+	key.upAxis = 1;
+	key.lods = nullptr;
+	key.staticBuffer = 0;
+	key.numStatic = 0;
+	key.staticDirty = false;
+	key.staticLodLevel = 0;
+
+	switch (key.shapeType)
+	{
+	case BOX_SHAPE_PROXYTYPE:
+		key.dimensions = static_cast<const btBoxShape*>(shape)->getHalfExtentsWithMargin();
+		break;
+	case SPHERE_SHAPE_PROXYTYPE:
+	{
+		btScalar rad = static_cast<const btSphereShape*>(shape)->getRadius();
+		key.dimensions = btVector3(rad, rad, rad);
+		break;
+	}
+	case CAPSULE_SHAPE_PROXYTYPE:
+	{
+		const btCapsuleShape* capsule = static_cast<const btCapsuleShape*>(shape);
+		key.dimensions = btVector3(capsule->getRadius(), capsule->getHalfHeight(), 0);
+		key.upAxis = capsule->getUpAxis();
+		break;
+	}
+	case CYLINDER_SHAPE_PROXYTYPE:
+	{
+		const btCylinderShape* cylinder = static_cast<const btCylinderShape*>(shape);
+		key.upAxis = cylinder->getUpAxis();
+		key.dimensions = btVector3(cylinder->getRadius(), cylinder->getHalfExtentsWithMargin()[key.upAxis], 0);
+		break;
+	}
+	case CONE_SHAPE_PROXYTYPE:
+	{
+		const btConeShape* cone = static_cast<const btConeShape*>(shape);
+		key.dimensions = btVector3(cone->getRadius(), cone->getHeight(), 0);
+		key.upAxis = cone->getConeUpIndex();
+		break;
+	}
+	default:
+		return -1;
+	}
+
+	for (size_t b = 0; b < buckets.size(); ++b)
+	{
+		const RenderBucket& bucket = buckets[b];
+		if (bucket.shapeType == key.shapeType && bucket.upAxis == key.upAxis && bucket.dimensions == key.dimensions)
+			return static_cast<int>(b);
+	}
+
+	// all supported shapes are centered at their origin
+	btVector3 center;
+	shape->getBoundingSphere(center, key.boundingRadius);
+
+	buckets.push_back(key);
+
+	return static_cast<int>(buckets.size() - 1);
+}
+
+GLMeshLodChain* RenderBuckets::createLods(const RenderBucket& bucket) const
+{
+	const btVector3& d = bucket.dimensions;
+
+	GLMeshLodChain* lods = new GLMeshLodChain;
+	if (bucket.shapeType == SPHERE_SHAPE_PROXYTYPE)
+	{
+		lods->createSphere(d.x());
+		return lods;
+	}
+
+	// a box has nothing to drop, the other shapes keep a single level for now
+	GLMeshData* mesh = new GLMeshData;
+	switch (bucket.shapeType)
+	{
+	case BOX_SHAPE_PROXYTYPE:
+		mesh->createBox(2.0f * d.x(), 2.0f * d.y(), 2.0f * d.z());
+		break;
+	case CAPSULE_SHAPE_PROXYTYPE:
+		mesh->createCapsule(d.x(), d.y(), 32, 16, bucket.upAxis);
+		break;
+	case CYLINDER_SHAPE_PROXYTYPE:
+		mesh->createCylinder(d.x(), d.y(), 32, bucket.upAxis);
+		break;
+	case CONE_SHAPE_PROXYTYPE:
+		mesh->createCone(d.x(), d.y(), 32, bucket.upAxis);
+		break;
+	}
+
+	lods->addLevel(mesh, 0.0f);
+
+	return lods;
+}
+
+int RenderBuckets::addBody(btRigidBody* body, const float* albedo)
+{
+	int b = findOrCreateBucket(body->getCollisionShape());
+
+	body->setUserIndex(b);
+	if (b < 0)
+		return b;
+
+	RenderBucket& bucket = buckets[b];
+
+	GLInstanceData instance;
+	body->getWorldTransform().getOpenGLMatrix(instance.model);
+	instance.albedo[0] = albedo[0];
+	instance.albedo[1] = albedo[1];
+	instance.albedo[2] = albedo[2];
+	instance.albedo[3] = 1.0f;
+
+	body->setUserIndex2(static_cast<int>(bucket.bodies.size()));
+	bucket.bodies.push_back(body);
+	bucket.instances.push_back(instance);
+	bucket.visible.push_back(1);
+	bucket.restFrames.push_back(0);
+	bucket.inStaticBatch.push_back(0);
+	bucket.lodLevels.push_back(0);
+
+	return b;
+}
+
+void RenderBuckets::removeBody(btRigidBody* body)
+{
+	int b = body->getUserIndex();
+	if (b < 0 || b >= getNumBuckets())
+		return;
+
+	RenderBucket& bucket = buckets[b];
+
+	// swap with the last slot to keep the bucket dense
+	int slot = body->getUserIndex2();
+	int last = static_cast<int>(bucket.bodies.size()) - 1;
+	if (bucket.inStaticBatch[slot])
+		bucket.staticDirty = true;
+
+	if (slot != last)
+	{
+		bucket.bodies[slot] = bucket.bodies[last];
+		bucket.instances[slot] = bucket.instances[last];
+		bucket.restFrames[slot] = bucket.restFrames[last];
+		bucket.inStaticBatch[slot] = bucket.inStaticBatch[last];
+		bucket.lodLevels[slot] = bucket.lodLevels[last];
+		bucket.bodies[slot]->setUserIndex2(slot);
+	}
+	bucket.bodies.pop_back();
+	bucket.instances.pop_back();
+	bucket.visible.pop_back();
+	bucket.restFrames.pop_back();
+	bucket.inStaticBatch.pop_back();
+	bucket.lodLevels.pop_back();
+
+	body->setUserIndex(-1);
+	body->setUserIndex2(-1);
+}
+
+// collects the leaves of the frustum query, fully inside subtrees are enumerated without further plane tests
+struct FrustumCullPolicy : btDbvt::ICollide
+{
+	std::vector<RenderBucket>& buckets;
+
+	FrustumCullPolicy(std::vector<RenderBucket>& buckets)
+		: buckets(buckets)
+	{
+	}
+
+	bool AllLeaves(const btDbvtNode* node)
+	{
+		if (node->isleaf())
+			return true;
+
+		btDbvt::enumLeaves(node, *this);
+		return false;
+	}
+
+	void Process(const btDbvtNode* leaf)
+	{
+		const btDbvtProxy* proxy = static_cast<const btDbvtProxy*>(leaf->data);
+		const btCollisionObject* obj = static_cast<const btCollisionObject*>(proxy->m_clientObject);
+
+		// the ground plane and other unbucketed objects
+		int b = obj->getUserIndex();
+		if (b < 0 || b >= static_cast<int>(buckets.size()))
+			return;
+
+		RenderBucket& bucket = buckets[b];
+		int slot = obj->getUserIndex2();
+		if (slot >= 0 && slot < static_cast<int>(bucket.bodies.size()) && bucket.bodies[slot] == obj)
+			bucket.visible[slot] = 1;
+	}
+};
+
+bool RenderBuckets::cullBroadphase(const Frustum& frustum, btBroadphaseInterface* broadphase)
+{
+	btDbvtBroadphase* dbvt = findDbvtBroadphase(broadphase);
+	if (!dbvt)
+		return false;
+
+	for (size_t b = 0; b < buckets.size(); ++b)
+		std::fill(buckets[b].visible.begin(), buckets[b].visible.end(), 0);
+
+	// dynamic and fixed set, sleeping bodies live in the latter
+	FrustumCullPolicy policy(buckets);
+	for (int set = 0; set < 2; ++set)
+	{
+		if (dbvt->m_sets[set].m_root)
+			btDbvt::collideKDOP(dbvt->m_sets[set].m_root, frustum.normals, frustum.offsets, Frustum::NumPlanes, policy);
+	}
+
+	return true;
+}
+
+int RenderBuckets::getNumStatic() const
+{
+	int numStatic = 0;
+	for (size_t b = 0; b < buckets.size(); ++b)
+		numStatic += static_cast<int>(buckets[b].numStatic);
+
+	return numStatic;
+}
+
+void RenderBuckets::pushTransform(const RenderBucket& bucket, size_t i, const PhysicsSnapshot* snapshot, float alpha)
+{
+	const btRigidBody* body = bucket.bodies[i];
+	int slot = static_cast<int>(i);
+
+	if (snapshot)
+	{
+		// bodies added after the snapshot was taken keep their last known matrix
+		btTransform transform;
+		if (snapshot->getTransform(body, alpha, transform))
+			batch.push(transform, slot);
+		else
+			batch.pushMatrix(bucket.instances[i].model, slot);
+	}
+	else if (body->getMotionState())
+	{
+		// the interpolated graphics transform, read directly instead of through the virtual getter
+		batch.push(static_cast<const btDefaultMotionState*>(body->getMotionState())->m_graphicsWorldTrans, slot);
+	}
+	else
+	{
+		batch.push(body->getWorldTransform(), slot);
+	}
+}
+
+void RenderBuckets::writeInstances(const RenderBucket& bucket, const TransformBatch& source, GLInstanceData* instances) const
+{
+	source.writeMatrices(instances[0].model, sizeof(GLInstanceData));
+	for (size_t k = 0; k < source.size(); ++k)
+	{
+		const GLfloat* albedo = bucket.instances[source.getSlot(k)].albedo;
+		std::copy(albedo, albedo + 4, instances[k].albedo);
+	}
+}
+
+void RenderBuckets::drawInstances(RenderBucket& bucket, const TransformBatch& source, GLMeshData* mesh)
+{
+	unsigned int count = static_cast<unsigned int>(source.size());
+	if (count == 0)
+		return;
+
+	// matrices go straight into the mapped stream buffer, or into the instance array that is uploaded
+	if (streamBuffer)
+	{
+		GLRingBuffer::Allocation allocation = streamBuffer->allocate(sizeof(GLInstanceData) * count);
+		writeInstances(bucket, source, static_cast<GLInstanceData*>(allocation.ptr));
+		streamBuffer->commit();
+
+		submit(mesh, nullptr, count, streamBuffer->getBufferID(), allocation.offset, getNearestDepth(bucket, source));
+	}
+	else
+	{
+		bucket.visibleInstances.resize(count);
+		writeInstances(bucket, source, bucket.visibleInstances.data());
+
+		mesh->setInstanceData(bucket.visibleInstances.data(), count);
+		submit(mesh, nullptr, count, 0, 0, getNearestDepth(bucket, source));
+	}
+
+	numVisible += static_cast<int>(count);
+}
+
+float RenderBuckets::getScreenRadius(const RenderBucket& bucket, btScalar distance) const
+{
+	// inside the bounding sphere counts as covering the whole view
+	if (distance <= bucket.boundingRadius)
+		return 1e30f;
+
+	return static_cast<float>(bucket.boundingRadius / distance) * lodScale;
+}
+
+void RenderBuckets::updateRestState(RenderBucket& bucket, const PhysicsSnapshot* snapshot)
+{
+	for (size_t i = 0; i < bucket.bodies.size(); ++i)
+	{
+		btRigidBody* body = bucket.bodies[i];
+
+		// Bullet only writes the motion states of active bodies, the snapshot records the activation instead
+		bool moved;
+		if (snapshot)
+			moved = !snapshot->isAtRest(body);
+		else if (body->getMotionState())
+			moved = static_cast<TrackedMotionState*>(body->getMotionState())->consumeMoved();
+		else
+			moved = body->isActive();
+
+		if (moved)
+		{
+			bucket.restFrames[i] = 0;
+			if (bucket.inStaticBatch[i])
+			{
+				bucket.inStaticBatch[i] = 0;
+				bucket.staticDirty = true;
+			}
+		}
+		else if (!bucket.inStaticBatch[i] && ++bucket.restFrames[i] >= staticBatchFrames)
+		{
+			bucket.inStaticBatch[i] = 1;
+			bucket.staticDirty = true;
+		}
+	}
+}
+
+void RenderBuckets::rebuildStaticBatch(RenderBucket& bucket, const PhysicsSnapshot* snapshot, float alpha)
+{
+	batch.clear();
+	for (size_t i = 0; i < bucket.bodies.size(); ++i)
+	{
+		if (bucket.inStaticBatch[i])
+			pushTransform(bucket, i, snapshot, alpha);
+	}
+
+	bucket.numStatic = static_cast<unsigned int>(batch.size());
+	bucket.staticDirty = false;
+	if (bucket.numStatic == 0)
+		return;
+
+	bucket.visibleInstances.resize(bucket.numStatic);
+	writeInstances(bucket, batch, bucket.visibleInstances.data());
+
+	// bounds of the whole batch for culling it as one
+	btVector3 radius(bucket.boundingRadius, bucket.boundingRadius, bucket.boundingRadius);
+	bucket.staticAabbMin = btVector3(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+	bucket.staticAabbMax = -bucket.staticAabbMin;
+	for (size_t k = 0; k < bucket.visibleInstances.size(); ++k)
+	{
+		const GLfloat* m = bucket.visibleInstances[k].model;
+		btVector3 origin(m[12], m[13], m[14]);
+		bucket.staticAabbMin.setMin(origin - radius);
+		bucket.staticAabbMax.setMax(origin + radius);
+	}
+
+	if (!bucket.staticBuffer)
+		glGenBuffers(1, &bucket.staticBuffer);
+
+	g_gl_state.bindBuffer(GL_ARRAY_BUFFER, bucket.staticBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLInstanceData) * bucket.numStatic, bucket.visibleInstances.data(), GL_DYNAMIC_DRAW);
+	g_gl_stats.bufferUploads++;
+}
+
+void RenderBuckets::render(const PhysicsSnapshot* snapshot, float alpha, const Frustum* frustum, btBroadphaseInterface* broadphase)
+{
+	// the broadphase tree matches the motion states only, a snapshot is tested body by body;
+	// with a physics thread the tree is also being modified concurrently
+	bool treeCulled = frustum && !snapshot && broadphase && cullBroadphase(*frustum, broadphase);
+	bool testSpheres = frustum && !treeCulled;
+
+	numVisible = 0;
+	impostorInstances.clear();
+	impostorDepth = BT_LARGE_FLOAT;
+	for (size_t b = 0; b < buckets.size(); ++b)
+	{
+		RenderBucket& bucket = buckets[b];
+		if (bucket.bodies.empty() && bucket.numStatic == 0)
+			continue;
+
+		if (!bucket.lods)
+			bucket.lods = createLods(bucket);
+
+		GLMeshLodChain& lods = *bucket.lods;
+		bool selectLods = lodScale > 0.0f && lods.getNumLevels() > 1;
+		bool useImpostors = impostors && bucket.shapeType == SPHERE_SHAPE_PROXYTYPE;
+
+		// resting bodies stay on the gpu, the batch is only rebuilt when its members change
+		if (staticBatchFrames > 0)
+			updateRestState(bucket, snapshot);
+		else if (bucket.numStatic)
+		{
+			std::fill(bucket.inStaticBatch.begin(), bucket.inStaticBatch.end(), 0);
+			bucket.staticDirty = true;
+		}
+
+		if (bucket.staticDirty)
+			rebuildStaticBatch(bucket, snapshot, alpha);
+
+		if (bucket.numStatic && (!frustum || frustum->intersects(bucket.staticAabbMin, bucket.staticAabbMax)))
+		{
+			btVector3 closest = lodEye;
+			closest.setMax(bucket.staticAabbMin);
+			closest.setMin(bucket.staticAabbMax);
+			btScalar closestDistance = (closest - lodEye).length();
+
+			// the whole batch gets the level of its closest point
+			if (selectLods)
+			{
+				float screenRadius = getScreenRadius(bucket, closestDistance + bucket.boundingRadius);
+				bucket.staticLodLevel = lods.selectLevel(screenRadius, bucket.staticLodLevel);
+			}
+			else
+				bucket.staticLodLevel = 0;
+
+			submit(lods.getMesh(bucket.staticLodLevel), nullptr, bucket.numStatic, bucket.staticBuffer, 0, closestDistance);
+			numVisible += static_cast<int>(bucket.numStatic);
+		}
+
+		// gather the moving candidates' transforms
+		batch.clear();
+		batch.reserve(bucket.bodies.size());
+		for (size_t i = 0; i < bucket.bodies.size(); ++i)
+		{
+			if (bucket.inStaticBatch[i] || (treeCulled && !bucket.visible[i]))
+				continue;
+
+			pushTransform(bucket, i, snapshot, alpha);
+		}
+
+		if (testSpheres)
+			batch.cull(*frustum, bucket.boundingRadius);
+
+		if (!selectLods && !useImpostors)
+		{
+			drawInstances(bucket, batch, lods.getMesh(0));
+			continue;
+		}
+
+		// pick every instance's level from its projected radius (or an impostor far enough away), then draw each level with one call
+		lodKeys.resize(batch.size());
+		for (size_t k = 0; k < batch.size(); ++k)
+		{
+			int slot = batch.getSlot(k);
+			btScalar distance = (batch.getOrigin(k) - lodEye).length();
+
+			if (useImpostors && distance >= impostorDistance)
+			{
+				lodKeys[k] = ImpostorKey;
+				continue;
+			}
+
+			if (selectLods)
+				bucket.lodLevels[slot] = static_cast<unsigned char>(lods.selectLevel(getScreenRadius(bucket, distance), bucket.lodLevels[slot]));
+			else
+				bucket.lodLevels[slot] = 0;
+
+			lodKeys[k] = bucket.lodLevels[slot];
+		}
+
+		for (int l = 0; l <= ImpostorKey; ++l)
+			lodBatches[l].clear();
+
+		batch.split(lodKeys.data(), lodBatches);
+
+		for (int l = 0; l < lods.getNumLevels(); ++l)
+			drawInstances(bucket, lodBatches[l], lods.getMesh(l));
+
+		const TransformBatch& impostorBatch = lodBatches[ImpostorKey];
+		for (size_t k = 0; k < impostorBatch.size(); ++k)
+		{
+			btVector3 center = impostorBatch.getOrigin(k);
+			const GLfloat* albedo = bucket.instances[impostorBatch.getSlot(k)].albedo;
+
+			GLImpostorData impostor;
+			impostor.centerRadius[0] = center.x();
+			impostor.centerRadius[1] = center.y();
+			impostor.centerRadius[2] = center.z();
+			impostor.centerRadius[3] = bucket.boundingRadius;
+			std::copy(albedo, albedo + 4, impostor.albedo);
+
+			impostorInstances.push_back(impostor);
+			impostorDepth = std::min(impostorDepth, static_cast<float>((center - lodEye).length() - bucket.boundingRadius));
+		}
+	}
+
+	drawImpostors();
+}
+
+float RenderBuckets::getNearestDepth(const RenderBucket& bucket, const TransformBatch& source) const
+{
+	if (!renderQueue)
+		return 0.0f;
+
+	btScalar nearest = BT_LARGE_FLOAT;
+	for (size_t k = 0; k < source.size(); ++k)
+		nearest = btMin(nearest, (source.getOrigin(k) - lodEye).length2());
+
+	return static_cast<float>(btSqrt(nearest) - bucket.boundingRadius);
+}
+
+void RenderBuckets::submit(GLMeshData* mesh, GLSphereImpostors* sphereImpostors, unsigned int count, GLuint instanceBuffer, GLintptr instanceOffset, float viewDepth)
+{
+	if (renderQueue)
+	{
+		GLDrawItem item = GLRenderQueue::makeItem(sphereImpostors ? impostorProgram : meshProgram);
+		item.mesh = mesh;
+		item.impostors = sphereImpostors;
+		item.instanceCount = count;
+		item.instanceBuffer = instanceBuffer;
+		item.instanceOffset = instanceOffset;
+
+		renderQueue->submit(item, viewDepth);
+		return;
+	}
+
+	// without a queue meshes use the program bound by the caller, impostors come last with their own
+	if (sphereImpostors)
+	{
+		g_gl_state.useProgram(impostorProgram);
+		if (instanceBuffer)
+			sphereImpostors->renderInstanced(count, instanceBuffer, instanceOffset);
+		else
+			sphereImpostors->renderInstanced(count);
+	}
+	else if (instanceBuffer)
+		mesh->renderInstanced(count, instanceBuffer, instanceOffset);
+	else
+		mesh->renderInstanced(count);
+}
+
+void RenderBuckets::drawImpostors()
+{
+	unsigned int count = static_cast<unsigned int>(impostorInstances.size());
+	if (count == 0)
+		return;
+
+	if (streamBuffer)
+	{
+		GLRingBuffer::Allocation allocation = streamBuffer->allocate(sizeof(GLImpostorData) * count);
+		std::copy(impostorInstances.begin(), impostorInstances.end(), static_cast<GLImpostorData*>(allocation.ptr));
+		streamBuffer->commit();
+
+		submit(nullptr, impostors, count, streamBuffer->getBufferID(), allocation.offset, impostorDepth);
+	}
+	else
+	{
+		impostors->setInstanceData(impostorInstances.data(), count);
+		submit(nullptr, impostors, count, 0, 0, impostorDepth);
+	}
+
+	numVisible += static_cast<int>(count);
+}
@@ -0,0 +1,194 @@
+#ifndef RENDERBUCKETS_H
+#define RENDERBUCKETS_H
+
+#include <vector>
+
+#include "glmeshdata.h"
+#include "glmeshlod.h"
+#include "glsphereimpostors.h"
+#include "transformbatch.h"
+
+#include "btBulletDynamicsCommon.h"
+
+struct PhysicsSnapshot;
+struct Frustum;
+class GLRingBuffer;
+class GLRenderQueue;
+
+// all bodies sharing one collision shape geometry, drawn with a single instanced call
+struct RenderBucket
+{
+	int shapeType;
+	btVector3 dimensions;
+	int upAxis;
+
+	// of the shape around its origin, for culling
+	btScalar boundingRadius;
+
+	GLMeshLodChain* lods;
+
+	std::vector<btRigidBody*> bodies;
+	std::vector<GLInstanceData> instances;
+
+	// per frame culling result, parallel to bodies, and the instances that survived it
+	std::vector<unsigned char> visible;
+	std::vector<GLInstanceData> visibleInstances;
+
+	// frames each body has been at rest and whether it moved into the static batch, parallel to bodies
+	std::vector<int> restFrames;
+	std::vector<unsigned char> inStaticBatch;
+
+	// level of detail each body was drawn with last, parallel to bodies
+	std::vector<unsigned char> lodLevels;
+
+	// resting bodies baked into their own instance buffer, only rebuilt when one joins or leaves
+	GLuint staticBuffer;
+	unsigned int numStatic;
+	bool staticDirty;
+	btVector3 staticAabbMin;
+	btVector3 staticAabbMax;
+	int staticLodLevel;
+};
+
+// maps Bullet shape types (and their dimensions) to render meshes once at body creation,
+// the body keeps its bucket in userIndex and its slot inside the bucket in userIndex2.
+// motion states are expected to be TrackedMotionState without center of mass offset (or none)
+class RenderBuckets
+{
+public:
+	RenderBuckets();
+	~RenderBuckets();
+
+	// returns the bucket index or -1 if the shape type has no render mesh (e.g. the static plane)
+	int addBody(btRigidBody* body, const float* albedo);
+	void removeBody(btRigidBody* body);
+
+	int getNumBuckets() const
+	{
+		return static_cast<int>(buckets.size());
+	}
+
+	RenderBucket& getBucket(int i)
+	{
+		return buckets[i];
+	}
+
+	// refresh the instance transforms and draw every bucket, the caller binds the instanced program
+	// (impostors are drawn last with their own program, which is left bound). with a render queue
+	// the draws are submitted to it instead and issued by its flush
+	// with a snapshot the transforms are interpolated from it instead of read from the motion states
+	// with a frustum bodies outside of it are skipped, the broadphase tree is queried when it is a
+	// btDbvtBroadphase and no snapshot is used, otherwise every body's bounding sphere is tested
+	void render(const PhysicsSnapshot* snapshot = nullptr, float alpha = 1.0f, const Frustum* frustum = nullptr, btBroadphaseInterface* broadphase = nullptr);
+
+	// stream instance data through this buffer instead of each mesh's own, nullptr to go back
+	void setStreamBuffer(GLRingBuffer* ringBuffer)
+	{
+		streamBuffer = ringBuffer;
+	}
+
+	// camera position and pixels per unit of radius at distance one (half the viewport height times
+	// the projection's y scale) for picking each instance's level of detail, 0 always draws the finest
+	void setLodView(const btVector3& eye, float pixelsPerUnit)
+	{
+		lodEye = eye;
+		lodScale = pixelsPerUnit;
+	}
+
+	// submit draws with meshProgram to queue instead of drawing right away, nullptr to go back
+	void setRenderQueue(GLRenderQueue* queue, GLuint meshProgram)
+	{
+		renderQueue = queue;
+		this->meshProgram = meshProgram;
+	}
+
+	// spheres farther than distance from the lod eye are drawn as ray traced impostors with program, nullptr disables them
+	void setImpostors(GLSphereImpostors* sphereImpostors, GLuint program, float distance)
+	{
+		impostors = sphereImpostors;
+		impostorProgram = program;
+		impostorDistance = distance;
+	}
+
+	// bodies at rest for this many frames are drawn from a static batch instead of being streamed, 0 disables it
+	void setStaticBatchFrames(int frames)
+	{
+		staticBatchFrames = frames;
+	}
+
+	// bodies currently drawn from static batches
+	int getNumStatic() const;
+
+	// bodies submitted by the last render call
+	int getNumVisible() const
+	{
+		return numVisible;
+	}
+
+	// drop every body at once (e.g. before the world is cleared), meshes and buffers are kept
+	void clearBodies();
+
+	// release meshes, must be called while the gl context is current
+	void clear();
+
+protected:
+	int findOrCreateBucket(const btCollisionShape* shape);
+	GLMeshLodChain* createLods(const RenderBucket& bucket) const;
+
+	// mark the bodies whose broadphase leaf intersects the frustum, false if the broadphase is no btDbvtBroadphase
+	bool cullBroadphase(const Frustum& frustum, btBroadphaseInterface* broadphase);
+
+	// update the rest counters from the motion states (or the snapshot) and move bodies in and out of the static batch
+	void updateRestState(RenderBucket& bucket, const PhysicsSnapshot* snapshot);
+	void rebuildStaticBatch(RenderBucket& bucket, const PhysicsSnapshot* snapshot, float alpha);
+
+	// append the transform body slot i is drawn with to the batch
+	void pushTransform(const RenderBucket& bucket, size_t i, const PhysicsSnapshot* snapshot, float alpha);
+	// write the source batch's matrices and the matching albedos
+	void writeInstances(const RenderBucket& bucket, const TransformBatch& source, GLInstanceData* instances) const;
+	// one instanced draw of the source batch's entries
+	void drawInstances(RenderBucket& bucket, const TransformBatch& source, GLMeshData* mesh);
+
+	// submit the impostors gathered by render with the impostor program
+	void drawImpostors();
+
+	// draw now, or hand the draw to the render queue when one is set
+	void submit(GLMeshData* mesh, GLSphereImpostors* sphereImpostors, unsigned int count, GLuint instanceBuffer, GLintptr instanceOffset, float viewDepth);
+	// distance from the eye to the closest bounding sphere of the batch, for the queue's front to back order
+	float getNearestDepth(const RenderBucket& bucket, const TransformBatch& source) const;
+
+	// projected radius of the bucket's shape at distance, in pixels
+	float getScreenRadius(const RenderBucket& bucket, btScalar distance) const;
+
+	std::vector<RenderBucket> buckets;
+	int numVisible;
+
+	// transforms of the bucket being drawn, reused across buckets and frames
+	TransformBatch batch;
+	// the batch split by level of detail, impostors go to the last one
+	enum { ImpostorKey = GLMeshLodChain::MaxLevels };
+	TransformBatch lodBatches[GLMeshLodChain::MaxLevels + 1];
+	std::vector<unsigned char> lodKeys;
+
+	btVector3 lodEye;
+	float lodScale;
+
+	// impostors of all sphere buckets, drawn with one call after the meshes
+	GLSphereImpostors* impostors;
+	GLuint impostorProgram;
+	float impostorDistance;
+	std::vector<GLImpostorData> impostorInstances;
+	float impostorDepth;
+
+	GLRenderQueue* renderQueue;
+	GLuint meshProgram;
+
+	GLRingBuffer* streamBuffer;
+	int staticBatchFrames;
+
+private:
+	RenderBuckets(const RenderBuckets& that);
+	RenderBuckets& operator=(const RenderBuckets& that);
+};
+
+#endif
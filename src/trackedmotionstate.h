@@ -0,0 +1,36 @@
+#ifndef TRACKEDMOTIONSTATE_H
+#define TRACKEDMOTIONSTATE_H
+
+#include "btBulletDynamicsCommon.h"
+
+// btDefaultMotionState that flags every transform Bullet writes back, which it only does for active bodies,
+// so a renderer can tell moving bodies from resting ones without comparing transforms
+ATTRIBUTE_ALIGNED16(class) TrackedMotionState : public btDefaultMotionState
+{
+public:
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+
+	TrackedMotionState(const btTransform& startTrans = btTransform::getIdentity())
+		: btDefaultMotionState(startTrans), moved(true)
+	{
+	}
+
+	virtual void setWorldTransform(const btTransform& centerOfMassWorldTrans)
+	{
+		btDefaultMotionState::setWorldTransform(centerOfMassWorldTrans);
+		moved = true;
+	}
+
+	// true if the body moved since the previous call
+	bool consumeMoved()
+	{
+		bool wasMoved = moved;
+		moved = false;
+		return wasMoved;
+	}
+
+private:
+	bool moved;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "transformbatch.h"
+#include "frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRANSFORMBATCH_SSE
+#include <xmmintrin.h>
+#endif
+
+void TransformBatch::clear()
+{
+	for (int l = 0; l < NumLanes; ++l)
+		lanes[l].clear();
+
+	slots.clear();
+}
+
+void TransformBatch::reserve(size_t capacity)
+{
+	for (int l = 0; l < NumLanes; ++l)
+		lanes[l].reserve(capacity);
+
+	slots.reserve(capacity);
+}
+
+void TransformBatch::push(const btTransform& transform, int slot)
+{
+	const btMatrix3x3& basis = transform.getBasis();
+	const btVector3& origin = transform.getOrigin();
+
+	for (int r = 0; r < 3; ++r)
+	{
+		for (int c = 0; c < 3; ++c)
+			lanes[3 * r + c].push_back(static_cast<float>(basis[r][c]));
+	}
+
+	lanes[OriginX + 0].push_back(static_cast<float>(origin.x()));
+	lanes[OriginX + 1].push_back(static_cast<float>(origin.y()));
+	lanes[OriginX + 2].push_back(static_cast<float>(origin.z()));
+
+	slots.push_back(slot);
+}
+
+void TransformBatch::pushMatrix(const float* m, int slot)
+{
+	for (int r = 0; r < 3; ++r)
+	{
+		for (int c = 0; c < 3; ++c)
+			lanes[3 * r + c].push_back(m[4 * c + r]);
+	}
+
+	lanes[OriginX + 0].push_back(m[12]);
+	lanes[OriginX + 1].push_back(m[13]);
+	lanes[OriginX + 2].push_back(m[14]);
+
+	slots.push_back(slot);
+}
+
+void TransformBatch::split(const unsigned char* keys, TransformBatch* dest) const
+{
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		TransformBatch& target = dest[keys[i]];
+		for (int l = 0; l < NumLanes; ++l)
+			target.lanes[l].push_back(lanes[l][i]);
+
+		target.slots.push_back(slots[i]);
+	}
+}
+
+void TransformBatch::cull(const Frustum& frustum, btScalar radius)
+{
+	const float* ox = lanes[OriginX + 0].data();
+	const float* oy = lanes[OriginX + 1].data();
+	const float* oz = lanes[OriginX + 2].data();
+
+	size_t numKept = 0;
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		bool inside = true;
+		for (int p = 0; p < Frustum::NumPlanes && inside; ++p)
+		{
+			const btVector3& n = frustum.normals[p];
+			inside = n.x() * ox[i] + n.y() * oy[i] + n.z() * oz[i] + frustum.offsets[p] >= -radius;
+		}
+
+		if (!inside)
+			continue;
+
+		if (numKept != i)
+		{
+			for (int l = 0; l < NumLanes; ++l)
+				lanes[l][numKept] = lanes[l][i];
+			slots[numKept] = slots[i];
+		}
+		numKept++;
+	}
+
+	for (int l = 0; l < NumLanes; ++l)
+		lanes[l].resize(numKept);
+	slots.resize(numKept);
+}
+
+// column-major: columns are the basis columns, the last one the origin
+static inline void writeMatrixScalar(const std::vector<float>* lanes, size_t i, float* m)
+{
+	for (int c = 0; c < 3; ++c)
+	{
+		m[4 * c + 0] = lanes[c][i];
+		m[4 * c + 1] = lanes[3 + c][i];
+		m[4 * c + 2] = lanes[6 + c][i];
+		m[4 * c + 3] = 0.0f;
+	}
+
+	m[12] = lanes[9][i];
+	m[13] = lanes[10][i];
+	m[14] = lanes[11][i];
+	m[15] = 1.0f;
+}
+
+void TransformBatch::writeMatrices(float* dest, size_t strideBytes) const
+{
+	char* out = reinterpret_cast<char*>(dest);
+	size_t count = slots.size();
+	size_t i = 0;
+
+#ifdef TRANSFORMBATCH_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// four entries per iteration, each lane load transposes into one matrix column of four entries
+	for (; i + 4 <= count; i += 4)
+	{
+		float* m0 = reinterpret_cast<float*>(out + strideBytes * (i + 0));
+		float* m1 = reinterpret_cast<float*>(out + strideBytes * (i + 1));
+		float* m2 = reinterpret_cast<float*>(out + strideBytes * (i + 2));
+		float* m3 = reinterpret_cast<float*>(out + strideBytes * (i + 3));
+
+		for (int c = 0; c < 3; ++c)
+		{
+			__m128 x = _mm_loadu_ps(&lanes[c][i]);
+			__m128 y = _mm_loadu_ps(&lanes[3 + c][i]);
+			__m128 z = _mm_loadu_ps(&lanes[6 + c][i]);
+			__m128 w = zero;
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+
+			_mm_storeu_ps(m0 + 4 * c, x);
+			_mm_storeu_ps(m1 + 4 * c, y);
+			_mm_storeu_ps(m2 + 4 * c, z);
+			_mm_storeu_ps(m3 + 4 * c, w);
+		}
+
+		__m128 x = _mm_loadu_ps(&lanes[OriginX + 0][i]);
+		__m128 y = _mm_loadu_ps(&lanes[OriginX + 1][i]);
+		__m128 z = _mm_loadu_ps(&lanes[OriginX + 2][i]);
+		__m128 w = one;
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		_mm_storeu_ps(m0 + 12, x);
+		_mm_storeu_ps(m1 + 12, y);
+		_mm_storeu_ps(m2 + 12, z);
+		_mm_storeu_ps(m3 + 12, w);
+	}
+#endif
+
+	for (; i < count; ++i)
+		writeMatrixScalar(lanes, i, reinterpret_cast<float*>(out + strideBytes * i));
+}
@@ -0,0 +1,55 @@
+#ifndef TRANSFORMBATCH_H
+#define TRANSFORMBATCH_H
+
+#include <vector>
+
+#include "btBulletDynamicsCommon.h"
+
+struct Frustum;
+
+// rigid transforms gathered into structure-of-arrays float lanes, converted to column-major
+// 4x4 matrices four at a time with SSE (scalar fallback without it)
+class TransformBatch
+{
+public:
+	void clear();
+	void reserve(size_t capacity);
+
+	size_t size() const
+	{
+		return slots.size();
+	}
+
+	// slot is a caller defined index carried along, e.g. the body's slot in its render bucket
+	void push(const btTransform& transform, int slot);
+	// append an existing column-major matrix, e.g. a body's last known instance matrix
+	void pushMatrix(const float* matrix, int slot);
+
+	int getSlot(size_t i) const
+	{
+		return slots[i];
+	}
+
+	btVector3 getOrigin(size_t i) const
+	{
+		return btVector3(lanes[OriginX][i], lanes[OriginX + 1][i], lanes[OriginX + 2][i]);
+	}
+
+	// drop the entries whose bounding sphere (centered at the origin) is outside the frustum, keeps the order
+	void cull(const Frustum& frustum, btScalar radius);
+
+	// append every entry i to dest[keys[i]], keeps the order within each destination
+	void split(const unsigned char* keys, TransformBatch* dest) const;
+
+	// write every entry's matrix to dest, consecutive matrices are strideBytes apart
+	void writeMatrices(float* dest, size_t strideBytes) const;
+
+private:
+	// basis row-major r00 r01 r02 r10 .. r22 followed by the origin
+	enum { NumLanes = 12, OriginX = 9 };
+
+	std::vector<float> lanes[NumLanes];
+	std::vector<int> slots;
+};
+
+#endif